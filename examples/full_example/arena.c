@@ -0,0 +1,147 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "arena.h"
+
+#include <string.h>
+
+/* Big enough for a few thousand items and their names: */
+#define BLOCK_SIZE (64 * 1024)
+
+/* Enough for any of the types that we allocate: */
+#define ALIGNMENT (MAX (sizeof (gdouble), sizeof (gpointer)))
+
+struct _Arena
+{
+  /* The blocks, with the current one first: */
+  GSList *blocks;
+  gsize block_used;
+  gsize block_size;
+
+  gsize bytes_used;
+  gsize bytes_allocated;
+
+  /* The interned strings, keyed by themselves: */
+  GHashTable *interned;
+};
+
+Arena *
+arena_new (void)
+{
+  Arena *arena = g_new0 (Arena, 1);
+  arena->interned = g_hash_table_new (g_str_hash, g_str_equal);
+  return arena;
+}
+
+void
+arena_free (Arena *arena)
+{
+  g_return_if_fail (arena);
+
+  g_hash_table_destroy (arena->interned);
+
+  GSList *block = NULL;
+  for (block = arena->blocks; block; block = block->next)
+    g_free (block->data);
+  g_slist_free (arena->blocks);
+
+  g_free (arena);
+}
+
+static gpointer
+arena_alloc (Arena *arena, gsize size, gsize alignment)
+{
+  gsize offset = (arena->block_used + alignment - 1) & ~(alignment - 1);
+  if (!arena->blocks || offset + size > arena->block_size)
+  {
+    /* Anything that is too big for a block gets a block of its own: */
+    arena->block_size = MAX (BLOCK_SIZE, size);
+    arena->blocks = g_slist_prepend (arena->blocks, g_malloc (arena->block_size));
+    arena->bytes_allocated += arena->block_size;
+    offset = 0;
+  }
+
+  arena->block_used = offset + size;
+  arena->bytes_used += size;
+
+  return (guchar*)arena->blocks->data + offset;
+}
+
+gpointer
+arena_alloc0 (Arena *arena, gsize size)
+{
+  g_return_val_if_fail (arena, NULL);
+
+  gpointer result = arena_alloc (arena, size, ALIGNMENT);
+  memset (result, 0, size);
+  return result;
+}
+
+gchar *
+arena_strndup (Arena *arena, const gchar *str, gsize length)
+{
+  g_return_val_if_fail (arena, NULL);
+  g_return_val_if_fail (str, NULL);
+
+  /* Strings need no alignment, so they are packed tightly: */
+  gchar *result = arena_alloc (arena, length + 1, 1);
+  memcpy (result, str, length);
+  result[length] = '\0';
+  return result;
+}
+
+const gchar *
+arena_intern (Arena *arena, const gchar *str, gsize length)
+{
+  g_return_val_if_fail (arena, NULL);
+  g_return_val_if_fail (str, NULL);
+
+  /* The string is usually already there, so look for it without copying it
+   * to the arena, just to a temporary buffer on the stack if it is short:
+   */
+  gchar buffer[256];
+  gchar *key = length < sizeof (buffer) ? buffer : g_malloc (length + 1);
+  memcpy (key, str, length);
+  key[length] = '\0';
+
+  const gchar *result = g_hash_table_lookup (arena->interned, key);
+  if (!result)
+  {
+    result = arena_strndup (arena, str, length);
+    g_hash_table_insert (arena->interned, (gpointer)result, (gpointer)result);
+  }
+
+  if (key != buffer)
+    g_free (key);
+
+  return result;
+}
+
+gsize
+arena_get_bytes_used (Arena *arena)
+{
+  g_return_val_if_fail (arena, 0);
+
+  return arena->bytes_used;
+}
+
+gsize
+arena_get_bytes_allocated (Arena *arena)
+{
+  g_return_val_if_fail (arena, 0);
+
+  return arena->bytes_allocated;
+}
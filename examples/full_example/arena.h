@@ -0,0 +1,56 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef __EXAMPLE_ARENA_H__
+#define __EXAMPLE_ARENA_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Allocates many small objects and strings next to each other in large
+ * blocks, so that they don't each need a malloc() header and are close
+ * together in memory. They can not be freed one at a time, but are all
+ * freed at once by arena_free(), which only frees the blocks.
+ */
+typedef struct _Arena Arena;
+
+Arena       *arena_new (void);
+void         arena_free (Arena *arena);
+
+/* Returns zeroed memory, aligned for any type. */
+gpointer     arena_alloc0 (Arena *arena, gsize size);
+
+/* Copy the first length bytes of the string, adding a nul terminator.
+ * The copy may be overwritten later with a string that is no longer.
+ */
+gchar       *arena_strndup (Arena *arena, const gchar *str, gsize length);
+
+/* Like arena_strndup(), but returns the same copy each time for the same
+ * string, so a string that many objects share is only kept once.
+ */
+const gchar *arena_intern (Arena *arena, const gchar *str, gsize length);
+
+/* The bytes that have been allocated from the arena, and the size of its
+ * blocks, which is more because the last block is not full yet.
+ * The hash table of interned strings is not counted.
+ */
+gsize        arena_get_bytes_used (Arena *arena);
+gsize        arena_get_bytes_allocated (Arena *arena);
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_ARENA_H__ */
@@ -0,0 +1,234 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "atlasimage.h"
+#include "perfhud.h"
+#include <clutter/clutter.h>
+#include <cogl/cogl.h>
+
+G_DEFINE_TYPE (ExampleAtlasImage, example_atlas_image, CLUTTER_TYPE_ACTOR);
+
+static void
+example_atlas_image_clear (ExampleAtlasImage *image)
+{
+  if (image->region)
+  {
+    texture_atlas_region_free (image->region);
+    image->region = NULL;
+  }
+
+  if (image->texture_material)
+  {
+    cogl_handle_unref (image->texture_material);
+    image->texture_material = COGL_INVALID_HANDLE;
+  }
+
+  if (image->texture)
+  {
+    cogl_handle_unref (image->texture);
+    image->texture = COGL_INVALID_HANDLE;
+  }
+
+  image->placeholder_width = 0;
+  image->placeholder_height = 0;
+}
+
+/* An implementation for the ClutterActor::paint() vfunc: */
+static void
+example_atlas_image_paint (ClutterActor *actor)
+{
+  ExampleAtlasImage *image = EXAMPLE_ATLAS_IMAGE (actor);
+
+  CoglHandle material = COGL_INVALID_HANDLE;
+  gfloat tx1 = 0, ty1 = 0, tx2 = 1, ty2 = 1;
+  if (image->region)
+  {
+    material = texture_atlas_region_get_material (image->region);
+    texture_atlas_region_get_coords (image->region, &tx1, &ty1, &tx2, &ty2);
+  }
+  else
+    material = image->texture_material;
+
+  const guint8 opacity = clutter_actor_get_paint_opacity (actor);
+
+  ClutterActorBox box;
+  clutter_actor_get_allocation_box (actor, &box);
+
+  if (material == COGL_INVALID_HANDLE)
+  {
+    if (!image->placeholder_height)
+      return;
+
+    /* A light gray, premultiplied like the images: */
+    const guint8 gray = 0xd0 * opacity / 0xff;
+    example_perf_hud_note_material (NULL);
+    cogl_set_source_color4ub (gray, gray, gray, opacity);
+    cogl_rectangle (0, 0, box.x2 - box.x1, box.y2 - box.y1);
+    return;
+  }
+
+  /* The pixels are premultiplied, so the color must be too.
+   * When the opacity does not change, the material does not change,
+   * so Cogl can draw all the images in a page together:
+   */
+  cogl_material_set_color4ub (material, opacity, opacity, opacity, opacity);
+  cogl_set_source (material);
+  example_perf_hud_note_material (material);
+
+  cogl_rectangle_with_texture_coords (0, 0, box.x2 - box.x1, box.y2 - box.y1,
+    tx1, ty1, tx2, ty2);
+}
+
+/* An implementation for the ClutterActor::get_preferred_width() vfunc: */
+static void
+example_atlas_image_get_preferred_width (ClutterActor *actor,
+                                         gfloat for_height G_GNUC_UNUSED,
+                                         gfloat *min_width_p,
+                                         gfloat *natural_width_p)
+{
+  gint width = 0;
+  example_atlas_image_get_base_size (EXAMPLE_ATLAS_IMAGE (actor), &width, NULL);
+
+  if (min_width_p)
+    *min_width_p = 0;
+  if (natural_width_p)
+    *natural_width_p = width;
+}
+
+/* An implementation for the ClutterActor::get_preferred_height() vfunc: */
+static void
+example_atlas_image_get_preferred_height (ClutterActor *actor,
+                                          gfloat for_width G_GNUC_UNUSED,
+                                          gfloat *min_height_p,
+                                          gfloat *natural_height_p)
+{
+  gint height = 0;
+  example_atlas_image_get_base_size (EXAMPLE_ATLAS_IMAGE (actor), NULL, &height);
+
+  if (min_height_p)
+    *min_height_p = 0;
+  if (natural_height_p)
+    *natural_height_p = height;
+}
+
+static void
+example_atlas_image_dispose (GObject *object)
+{
+  example_atlas_image_clear (EXAMPLE_ATLAS_IMAGE (object));
+
+  G_OBJECT_CLASS (example_atlas_image_parent_class)->dispose (object);
+}
+
+static void
+example_atlas_image_class_init (ExampleAtlasImageClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  ClutterActorClass *actor_class = CLUTTER_ACTOR_CLASS (klass);
+
+  /* Provide implementations for ClutterActor vfuncs: */
+  actor_class->paint = example_atlas_image_paint;
+  actor_class->get_preferred_width = example_atlas_image_get_preferred_width;
+  actor_class->get_preferred_height = example_atlas_image_get_preferred_height;
+
+  gobject_class->dispose = example_atlas_image_dispose;
+}
+
+static void
+example_atlas_image_init (ExampleAtlasImage *image)
+{
+  image->region = NULL;
+  image->texture = COGL_INVALID_HANDLE;
+  image->texture_material = COGL_INVALID_HANDLE;
+  image->placeholder_width = 0;
+  image->placeholder_height = 0;
+}
+
+ClutterActor *
+example_atlas_image_new (void)
+{
+  return g_object_new (EXAMPLE_TYPE_ATLAS_IMAGE, NULL);
+}
+
+void
+example_atlas_image_set_region (ExampleAtlasImage *image, TextureAtlasRegion *region)
+{
+  g_return_if_fail (EXAMPLE_IS_ATLAS_IMAGE (image));
+
+  example_atlas_image_clear (image);
+  image->region = region;
+
+  clutter_actor_queue_relayout (CLUTTER_ACTOR (image));
+}
+
+void
+example_atlas_image_set_cogl_texture (ExampleAtlasImage *image, CoglHandle texture)
+{
+  g_return_if_fail (EXAMPLE_IS_ATLAS_IMAGE (image));
+
+  /* Take the reference first, in case it is the texture that we already have: */
+  if (texture)
+    cogl_handle_ref (texture);
+
+  example_atlas_image_clear (image);
+
+  if (texture)
+  {
+    image->texture = texture;
+    image->texture_material = cogl_material_new ();
+    cogl_material_set_layer (image->texture_material, 0, texture);
+  }
+
+  clutter_actor_queue_relayout (CLUTTER_ACTOR (image));
+}
+
+void
+example_atlas_image_set_placeholder (ExampleAtlasImage *image, gint width, gint height)
+{
+  g_return_if_fail (EXAMPLE_IS_ATLAS_IMAGE (image));
+
+  example_atlas_image_clear (image);
+  image->placeholder_width = width;
+  image->placeholder_height = height;
+
+  /* The size stays the same, so we just need to draw it again: */
+  clutter_actor_queue_redraw (CLUTTER_ACTOR (image));
+}
+
+void
+example_atlas_image_get_base_size (ExampleAtlasImage *image, gint *width, gint *height)
+{
+  g_return_if_fail (EXAMPLE_IS_ATLAS_IMAGE (image));
+
+  gint result_width = 0;
+  gint result_height = 0;
+  if (image->region)
+    texture_atlas_region_get_size (image->region, &result_width, &result_height);
+  else if (image->texture)
+  {
+    result_width = cogl_texture_get_width (image->texture);
+    result_height = cogl_texture_get_height (image->texture);
+  }
+  else
+  {
+    result_width = image->placeholder_width;
+    result_height = image->placeholder_height;
+  }
+
+  if (width)
+    *width = result_width;
+  if (height)
+    *height = result_height;
+}
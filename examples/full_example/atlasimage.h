@@ -0,0 +1,87 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef __EXAMPLE_ATLAS_IMAGE_H__
+#define __EXAMPLE_ATLAS_IMAGE_H__
+
+#include <clutter/clutter.h>
+#include "textureatlas.h"
+
+G_BEGIN_DECLS
+
+#define EXAMPLE_TYPE_ATLAS_IMAGE                (example_atlas_image_get_type ())
+#define EXAMPLE_ATLAS_IMAGE(obj)                (G_TYPE_CHECK_INSTANCE_CAST ((obj), EXAMPLE_TYPE_ATLAS_IMAGE, ExampleAtlasImage))
+#define EXAMPLE_IS_ATLAS_IMAGE(obj)             (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EXAMPLE_TYPE_ATLAS_IMAGE))
+#define EXAMPLE_ATLAS_IMAGE_CLASS(klass)        (G_TYPE_CHECK_CLASS_CAST ((klass), EXAMPLE_TYPE_ATLAS_IMAGE, ExampleAtlasImageClass))
+#define EXAMPLE_IS_ATLAS_IMAGE_CLASS(klass)     (G_TYPE_CHECK_CLASS_TYPE ((klass), EXAMPLE_TYPE_ATLAS_IMAGE))
+#define EXAMPLE_ATLAS_IMAGE_GET_CLASS(obj)      (G_TYPE_INSTANCE_GET_CLASS ((obj), EXAMPLE_TYPE_ATLAS_IMAGE, ExampleAtlasImageClass))
+
+typedef struct _ExampleAtlasImage       ExampleAtlasImage;
+typedef struct _ExampleAtlasImageClass  ExampleAtlasImageClass;
+
+/* An actor that shows either a region of a TextureAtlas or a texture of its own.
+ * Images in the same atlas page are drawn with the same material, so Cogl can
+ * batch them into one draw call.
+ */
+struct _ExampleAtlasImage
+{
+  /*< private >*/
+  ClutterActor parent_instance;
+
+  /* One of these is set: */
+  TextureAtlasRegion *region;
+  CoglHandle texture;
+  CoglHandle texture_material;
+
+  /* Or, instead of an image, a plain rectangle of this size is drawn: */
+  gint placeholder_width;
+  gint placeholder_height;
+};
+
+struct _ExampleAtlasImageClass
+{
+  /*< private >*/
+  ClutterActorClass parent_class;
+};
+
+
+GType example_atlas_image_get_type (void) G_GNUC_CONST;
+
+ClutterActor *example_atlas_image_new (void);
+
+/* Show this region. The image takes ownership of the region,
+ * and frees any previous region or texture.
+ */
+void example_atlas_image_set_region (ExampleAtlasImage *image, TextureAtlasRegion *region);
+
+/* Show this texture, for images that are too big for the atlas.
+ * The image takes a reference, and frees any previous region or texture.
+ */
+void example_atlas_image_set_cogl_texture (ExampleAtlasImage *image, CoglHandle texture);
+
+/* Free any region or texture, and draw a plain rectangle of this size instead,
+ * until a region or texture is set again.
+ */
+void example_atlas_image_set_placeholder (ExampleAtlasImage *image, gint width, gint height);
+
+/* Like clutter_texture_get_base_size(): The size of the region or texture in pixels,
+ * or of the placeholder.
+ */
+void example_atlas_image_get_base_size (ExampleAtlasImage *image, gint *width, gint *height);
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_ATLAS_IMAGE_H__ */
@@ -0,0 +1,280 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "benchmark.h"
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <stdlib.h>
+
+typedef struct _BenchmarkMark
+{
+  const gchar *name;
+  gdouble seconds;
+}
+BenchmarkMark;
+
+struct _Benchmark
+{
+  GTimer *timer;
+  GArray *marks;
+
+  /* The samples of each kind, in seconds: */
+  GArray *samples[BENCHMARK_N_SAMPLES];
+  gdouble sample_start[BENCHMARK_N_SAMPLES];
+};
+
+static const gchar *sample_names[BENCHMARK_N_SAMPLES] =
+{
+  "paint_ms",
+  "layout_ms",
+  "frame_interval_ms",
+  "upload_ms"
+};
+
+Benchmark*
+benchmark_new (void)
+{
+  Benchmark *benchmark = g_new0 (Benchmark, 1);
+  benchmark->timer = g_timer_new ();
+  benchmark->marks = g_array_new (FALSE, FALSE, sizeof (BenchmarkMark));
+
+  guint i = 0;
+  for (i = 0; i < BENCHMARK_N_SAMPLES; ++i)
+    benchmark->samples[i] = g_array_new (FALSE, FALSE, sizeof (gdouble));
+
+  return benchmark;
+}
+
+void
+benchmark_free (Benchmark *benchmark)
+{
+  g_return_if_fail (benchmark);
+
+  guint i = 0;
+  for (i = 0; i < BENCHMARK_N_SAMPLES; ++i)
+    g_array_free (benchmark->samples[i], TRUE);
+
+  g_array_free (benchmark->marks, TRUE);
+  g_timer_destroy (benchmark->timer);
+  g_free (benchmark);
+}
+
+/* Fill the pixels with a pattern that is different for each image,
+ * with smooth areas and edges, so it compresses like a photo, roughly:
+ */
+static void
+fill_pixbuf (GdkPixbuf *pixbuf, guint seed)
+{
+  const gint width = gdk_pixbuf_get_width (pixbuf);
+  const gint height = gdk_pixbuf_get_height (pixbuf);
+  const gint rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+  const gint n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+  guchar *pixels = gdk_pixbuf_get_pixels (pixbuf);
+
+  const gint stripe = 16 + seed % 48;
+
+  gint y = 0;
+  for (y = 0; y < height; ++y)
+  {
+    guchar *p = pixels + y * rowstride;
+    gint x = 0;
+    for (x = 0; x < width; ++x)
+    {
+      p[0] = (x * 255 / width + seed * 37) & 0xff;
+      p[1] = (y * 255 / height + seed * 91) & 0xff;
+      p[2] = ((x + y) / stripe) % 2 ? 0xe0 : 0x20;
+      p += n_channels;
+    }
+  }
+}
+
+gchar*
+benchmark_create_images (guint n_images, gint width, gint height, GError **error)
+{
+  g_return_val_if_fail (width > 0 && height > 0, NULL);
+
+  gchar *directory_path = g_build_filename (g_get_tmp_dir (),
+    "full_example-benchmark-XXXXXX", NULL);
+  if (!mkdtemp (directory_path))
+  {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+      "mkdtemp() failed for %s", directory_path);
+    g_free (directory_path);
+    return NULL;
+  }
+
+  GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+
+  guint i = 0;
+  for (i = 0; i < n_images; ++i)
+  {
+    fill_pixbuf (pixbuf, i);
+
+    gchar *filename = g_strdup_printf ("image%05u.jpg", i);
+    gchar *path = g_build_filename (directory_path, filename, NULL);
+    g_free (filename);
+
+    const gboolean saved = gdk_pixbuf_save (pixbuf, path, "jpeg", error, "quality", "90", NULL);
+    g_free (path);
+
+    if (!saved)
+    {
+      g_object_unref (pixbuf);
+      benchmark_remove_directory (directory_path);
+      g_free (directory_path);
+      return NULL;
+    }
+  }
+
+  g_object_unref (pixbuf);
+  return directory_path;
+}
+
+void
+benchmark_remove_directory (const gchar *directory_path)
+{
+  g_return_if_fail (directory_path);
+
+  GDir *dir = g_dir_open (directory_path, 0, NULL);
+  if (dir)
+  {
+    const gchar *filename = NULL;
+    while ((filename = g_dir_read_name (dir)))
+    {
+      gchar *path = g_build_filename (directory_path, filename, NULL);
+      g_unlink (path);
+      g_free (path);
+    }
+
+    g_dir_close (dir);
+  }
+
+  g_rmdir (directory_path);
+}
+
+void
+benchmark_mark (Benchmark *benchmark, const gchar *name)
+{
+  g_return_if_fail (benchmark);
+
+  BenchmarkMark mark;
+  mark.name = name;
+  mark.seconds = g_timer_elapsed (benchmark->timer, NULL);
+  g_array_append_val (benchmark->marks, mark);
+}
+
+void
+benchmark_begin_sample (Benchmark *benchmark, BenchmarkSample sample)
+{
+  g_return_if_fail (benchmark);
+  g_return_if_fail (sample < BENCHMARK_N_SAMPLES);
+
+  benchmark->sample_start[sample] = g_timer_elapsed (benchmark->timer, NULL);
+}
+
+void
+benchmark_end_sample (Benchmark *benchmark, BenchmarkSample sample)
+{
+  g_return_if_fail (benchmark);
+  g_return_if_fail (sample < BENCHMARK_N_SAMPLES);
+
+  benchmark_add_sample (benchmark, sample,
+    g_timer_elapsed (benchmark->timer, NULL) - benchmark->sample_start[sample]);
+}
+
+void
+benchmark_add_sample (Benchmark *benchmark, BenchmarkSample sample, gdouble seconds)
+{
+  g_return_if_fail (benchmark);
+  g_return_if_fail (sample < BENCHMARK_N_SAMPLES);
+
+  g_array_append_val (benchmark->samples[sample], seconds);
+}
+
+static gint
+compare_doubles (gconstpointer a, gconstpointer b)
+{
+  const gdouble value_a = *(const gdouble*)a;
+  const gdouble value_b = *(const gdouble*)b;
+
+  if (value_a != value_b)
+    return value_a < value_b ? -1 : 1;
+
+  return 0;
+}
+
+/* The nearest-rank percentile of sorted samples, in milliseconds: */
+static gdouble
+get_percentile (GArray *sorted, gdouble percentile)
+{
+  if (!sorted->len)
+    return 0;
+
+  guint rank = (guint)(percentile / 100 * sorted->len + 0.5);
+  rank = CLAMP (rank, 1, sorted->len);
+  return g_array_index (sorted, gdouble, rank - 1) * 1000;
+}
+
+static glong
+get_peak_rss_kb (void)
+{
+  struct rusage usage;
+  if (getrusage (RUSAGE_SELF, &usage) != 0)
+    return 0;
+
+  /* Linux reports this in kilobytes: */
+  return usage.ru_maxrss;
+}
+
+void
+benchmark_print_results (Benchmark *benchmark, FILE *file, const gchar *extra_json)
+{
+  g_return_if_fail (benchmark);
+  g_return_if_fail (file);
+
+  GString *json = g_string_new ("{");
+  if (extra_json && *extra_json)
+    g_string_append_printf (json, "%s, ", extra_json);
+
+  guint i = 0;
+  for (i = 0; i < benchmark->marks->len; ++i)
+  {
+    const BenchmarkMark *mark = &g_array_index (benchmark->marks, BenchmarkMark, i);
+    g_string_append_printf (json, "\"%s\": %.3f, ", mark->name, mark->seconds * 1000);
+  }
+
+  for (i = 0; i < BENCHMARK_N_SAMPLES; ++i)
+  {
+    GArray *samples = benchmark->samples[i];
+    g_array_sort (samples, compare_doubles);
+
+    g_string_append_printf (json,
+      "\"%s\": {\"count\": %u, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}, ",
+      sample_names[i], samples->len,
+      get_percentile (samples, 50), get_percentile (samples, 90),
+      get_percentile (samples, 99), get_percentile (samples, 100));
+  }
+
+  g_string_append_printf (json, "\"peak_rss_kb\": %ld}\n", get_peak_rss_kb ());
+
+  fputs (json->str, file);
+  fflush (file);
+  g_string_free (json, TRUE);
+}
@@ -0,0 +1,78 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef __EXAMPLE_BENCHMARK_H__
+#define __EXAMPLE_BENCHMARK_H__
+
+#include <glib.h>
+#include <stdio.h>
+
+G_BEGIN_DECLS
+
+/* Collects timings while the example runs a scripted series of rotations,
+ * and prints them, with the peak memory use, as one line of JSON.
+ */
+typedef struct _Benchmark Benchmark;
+
+typedef enum
+{
+  BENCHMARK_SAMPLE_PAINT,          /* Painting the stage. */
+  BENCHMARK_SAMPLE_LAYOUT,         /* Laying out the items, and choosing their textures. */
+  BENCHMARK_SAMPLE_FRAME_INTERVAL, /* The time between two frames of the rotation. */
+  BENCHMARK_SAMPLE_UPLOAD,         /* Uploading textures, in the frames that upload any. */
+  BENCHMARK_N_SAMPLES
+}
+BenchmarkSample;
+
+Benchmark   *benchmark_new (void);
+void         benchmark_free (Benchmark *benchmark);
+
+/* Write n_images JPEG files of this size, with different contents, to a new
+ * temporary directory, and return its path, or NULL if that failed.
+ */
+gchar       *benchmark_create_images (guint    n_images,
+                                      gint     width,
+                                      gint     height,
+                                      GError **error);
+
+/* Delete the directory and all the files in it. */
+void         benchmark_remove_directory (const gchar *directory_path);
+
+/* Remember the time since benchmark_new() with this name, such as "load_ms". */
+void         benchmark_mark (Benchmark   *benchmark,
+                             const gchar *name);
+
+/* Measure the time between these two calls: */
+void         benchmark_begin_sample (Benchmark       *benchmark,
+                                     BenchmarkSample  sample);
+void         benchmark_end_sample (Benchmark       *benchmark,
+                                   BenchmarkSample  sample);
+
+/* Add a time that was measured some other way, in seconds: */
+void         benchmark_add_sample (Benchmark       *benchmark,
+                                   BenchmarkSample  sample,
+                                   gdouble          seconds);
+
+/* Print the marks, the percentiles of the samples, in milliseconds,
+ * and the peak resident set size, on one line:
+ */
+void         benchmark_print_results (Benchmark   *benchmark,
+                                      FILE        *file,
+                                      const gchar *extra_json);
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_BENCHMARK_H__ */
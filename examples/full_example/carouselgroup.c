@@ -0,0 +1,624 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "carouselgroup.h"
+#include <clutter/clutter.h>
+#include <stdlib.h>
+
+static void example_carousel_group_container_init (ClutterContainerIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (ExampleCarouselGroup, example_carousel_group, CLUTTER_TYPE_ACTOR,
+  G_IMPLEMENT_INTERFACE (CLUTTER_TYPE_CONTAINER, example_carousel_group_container_init));
+
+/* Children that have moved further than this, in total, in one frame,
+ * are sorted with a full sort instead, which is then quicker:
+ */
+#define MAX_MOVES_PER_CHILD 8
+
+/* Only the first occluders from the front are remembered while painting,
+ * because those are usually the biggest, so that culling stays cheap:
+ */
+#define MAX_OCCLUDERS 16
+
+/* A rectangle in window coordinates: */
+typedef struct _ScreenRect
+{
+  gfloat x1, y1, x2, y2;
+} ScreenRect;
+
+typedef struct _SortEntry
+{
+  gfloat depth;
+  guint position;
+  ClutterActor *actor;
+} SortEntry;
+
+static gint
+compare_sort_entries (gconstpointer a, gconstpointer b)
+{
+  const SortEntry *entry_a = (const SortEntry*)a;
+  const SortEntry *entry_b = (const SortEntry*)b;
+
+  if (entry_a->depth != entry_b->depth)
+    return entry_a->depth < entry_b->depth ? -1 : 1;
+
+  /* Keep children with the same depth in the same order, like ClutterGroup: */
+  return entry_a->position < entry_b->position ? -1 : 1;
+}
+
+static void
+example_carousel_group_full_sort (ExampleCarouselGroup *group)
+{
+  const guint n_children = group->children->len;
+  ClutterActor **actors = (ClutterActor**)group->children->pdata;
+
+  SortEntry *entries = g_new (SortEntry, n_children);
+  guint i = 0;
+  for (i = 0; i < n_children; ++i)
+  {
+    entries[i].depth = group->depths[i];
+    entries[i].position = i;
+    entries[i].actor = actors[i];
+  }
+
+  qsort (entries, n_children, sizeof (SortEntry), compare_sort_entries);
+
+  for (i = 0; i < n_children; ++i)
+  {
+    group->depths[i] = entries[i].depth;
+    actors[i] = entries[i].actor;
+  }
+
+  g_free (entries);
+}
+
+void
+example_carousel_group_sort_depth_order (ExampleCarouselGroup *group)
+{
+  g_return_if_fail (EXAMPLE_IS_CAROUSEL_GROUP (group));
+
+  if (!group->needs_sort)
+    return;
+
+  group->needs_sort = FALSE;
+
+  const guint n_children = group->children->len;
+  if (n_children > group->n_allocated)
+  {
+    group->n_allocated = MAX (n_children, group->n_allocated * 2);
+    group->depths = g_renew (gfloat, group->depths, group->n_allocated);
+    group->culled = g_renew (gboolean, group->culled, group->n_allocated);
+  }
+
+  ClutterActor **actors = (ClutterActor**)group->children->pdata;
+  guint i = 0;
+  for (i = 0; i < n_children; ++i)
+    group->depths[i] = clutter_actor_get_depth (actors[i]);
+
+  /* An insertion sort, starting from the order of the last frame.
+   * It is stable, so children with the same depth keep their order:
+   */
+  const gsize max_moves = (gsize)n_children * MAX_MOVES_PER_CHILD;
+  gsize n_moves = 0;
+  for (i = 1; i < n_children && n_moves <= max_moves; ++i)
+  {
+    const gfloat depth = group->depths[i];
+    ClutterActor *actor = actors[i];
+
+    guint j = i;
+    while (j > 0 && group->depths[j - 1] > depth)
+    {
+      group->depths[j] = group->depths[j - 1];
+      actors[j] = actors[j - 1];
+      --j;
+    }
+
+    group->depths[j] = depth;
+    actors[j] = actor;
+    n_moves += i - j;
+  }
+
+  /* The order had changed too much, for instance when the children were
+   * first added, so sort the rest of the way with a full sort:
+   */
+  if (n_moves > max_moves)
+    example_carousel_group_full_sort (group);
+}
+
+/* An implementation for the ClutterContainer::add() vfunc: */
+static void
+example_carousel_group_add (ClutterContainer *container, ClutterActor *actor)
+{
+  ExampleCarouselGroup *group = EXAMPLE_CAROUSEL_GROUP (container);
+
+  g_object_ref (actor);
+
+  g_ptr_array_add (group->children, actor);
+  clutter_actor_set_parent (actor, CLUTTER_ACTOR (group));
+  group->needs_sort = TRUE;
+
+  clutter_actor_queue_relayout (CLUTTER_ACTOR (group));
+
+  g_signal_emit_by_name (container, "actor-added", actor);
+
+  g_object_unref (actor);
+}
+
+/* An implementation for the ClutterContainer::remove() vfunc: */
+static void
+example_carousel_group_remove (ClutterContainer *container, ClutterActor *actor)
+{
+  ExampleCarouselGroup *group = EXAMPLE_CAROUSEL_GROUP (container);
+
+  g_object_ref (actor);
+
+  /* This keeps the order of the other children: */
+  g_ptr_array_remove (group->children, actor);
+  g_hash_table_remove (group->occluders, actor);
+  g_hash_table_remove (group->culled_children, actor);
+  clutter_actor_unparent (actor);
+
+  clutter_actor_queue_relayout (CLUTTER_ACTOR (group));
+
+  g_signal_emit_by_name (container, "actor-removed", actor);
+
+  g_object_unref (actor);
+}
+
+/* An implementation for the ClutterContainer::foreach() vfunc.
+ * This goes from the last child to the first, so the callback may remove
+ * the child, for instance by destroying it.
+ */
+static void
+example_carousel_group_foreach (ClutterContainer *container, ClutterCallback callback,
+  gpointer user_data)
+{
+  ExampleCarouselGroup *group = EXAMPLE_CAROUSEL_GROUP (container);
+
+  guint i = group->children->len;
+  while (i > 0)
+  {
+    --i;
+    if (i < group->children->len)
+      callback (g_ptr_array_index (group->children, i), user_data);
+  }
+}
+
+/* Move the actor just after the sibling, or to the end, in the children array.
+ * Like ClutterGroup, this only lasts until the depths are sorted again,
+ * unless the actors have the same depth.
+ */
+static void
+example_carousel_group_move_child (ExampleCarouselGroup *group, ClutterActor *actor,
+  ClutterActor *sibling, gboolean after)
+{
+  if (!g_ptr_array_remove (group->children, actor))
+    return;
+
+  guint index = after ? group->children->len : 0;
+  if (sibling)
+  {
+    guint i = 0;
+    for (i = 0; i < group->children->len; ++i)
+    {
+      if (g_ptr_array_index (group->children, i) == sibling)
+      {
+        index = after ? i + 1 : i;
+        break;
+      }
+    }
+  }
+
+  /* Insert it by moving the later children along: */
+  g_ptr_array_add (group->children, actor);
+  ClutterActor **actors = (ClutterActor**)group->children->pdata;
+  g_memmove (actors + index + 1, actors + index,
+    (group->children->len - 1 - index) * sizeof (ClutterActor*));
+  actors[index] = actor;
+
+  clutter_actor_queue_redraw (CLUTTER_ACTOR (group));
+}
+
+/* An implementation for the ClutterContainer::raise() vfunc: */
+static void
+example_carousel_group_raise (ClutterContainer *container, ClutterActor *actor,
+  ClutterActor *sibling)
+{
+  example_carousel_group_move_child (EXAMPLE_CAROUSEL_GROUP (container), actor, sibling, TRUE);
+}
+
+/* An implementation for the ClutterContainer::lower() vfunc: */
+static void
+example_carousel_group_lower (ClutterContainer *container, ClutterActor *actor,
+  ClutterActor *sibling)
+{
+  example_carousel_group_move_child (EXAMPLE_CAROUSEL_GROUP (container), actor, sibling, FALSE);
+}
+
+/* An implementation for the ClutterContainer::sort_depth_order() vfunc.
+ * clutter_actor_set_depth() calls this for every child that moves,
+ * so we just sort once before the next paint.
+ */
+static void
+example_carousel_group_sort_depth_order_later (ClutterContainer *container)
+{
+  ExampleCarouselGroup *group = EXAMPLE_CAROUSEL_GROUP (container);
+
+  if (group->needs_sort)
+    return;
+
+  group->needs_sort = TRUE;
+  clutter_actor_queue_redraw (CLUTTER_ACTOR (group));
+}
+
+static void
+example_carousel_group_container_init (ClutterContainerIface *iface)
+{
+  iface->add = example_carousel_group_add;
+  iface->remove = example_carousel_group_remove;
+  iface->foreach = example_carousel_group_foreach;
+  iface->raise = example_carousel_group_raise;
+  iface->lower = example_carousel_group_lower;
+  iface->sort_depth_order = example_carousel_group_sort_depth_order_later;
+}
+
+/* Whether the point is inside the quadrilateral, or on its edge.
+ * The vertices are in the order of clutter_actor_get_abs_allocation_vertices().
+ */
+static gboolean
+point_in_quad (const ClutterVertex *vertices, gfloat x, gfloat y)
+{
+  /* The vertices in order around the edge: */
+  static const guint order[] = { 0, 1, 3, 2 };
+
+  gint side = 0;
+  guint i = 0;
+  for (i = 0; i < 4; ++i)
+  {
+    const ClutterVertex *a = &vertices[order[i]];
+    const ClutterVertex *b = &vertices[order[(i + 1) % 4]];
+    const gfloat cross = (b->x - a->x) * (y - a->y) - (b->y - a->y) * (x - a->x);
+    if (cross == 0)
+      continue;
+
+    const gint this_side = cross > 0 ? 1 : -1;
+    if (!side)
+      side = this_side;
+    else if (this_side != side)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Find a rectangle that is inside the transformed actor, such as the
+ * part of a tilted plane between its shorter edges.
+ * Returns FALSE if there is none, for instance if the actor is rotated
+ * around the z axis.
+ */
+static gboolean
+get_inner_rect (const ClutterVertex *vertices, ScreenRect *rect)
+{
+  /* The vertices are top-left, top-right, bottom-left, bottom-right,
+   * before any transformation, which may have flipped them:
+   */
+  const gboolean flipped_x = vertices[0].x > vertices[1].x;
+  const ClutterVertex *left_a = &vertices[flipped_x ? 1 : 0];
+  const ClutterVertex *left_b = &vertices[flipped_x ? 3 : 2];
+  const ClutterVertex *right_a = &vertices[flipped_x ? 0 : 1];
+  const ClutterVertex *right_b = &vertices[flipped_x ? 2 : 3];
+
+  const gboolean flipped_y = vertices[0].y > vertices[2].y;
+  const ClutterVertex *top_a = &vertices[flipped_y ? 2 : 0];
+  const ClutterVertex *top_b = &vertices[flipped_y ? 3 : 1];
+  const ClutterVertex *bottom_a = &vertices[flipped_y ? 0 : 2];
+  const ClutterVertex *bottom_b = &vertices[flipped_y ? 1 : 3];
+
+  /* Stay half a pixel inside, so rounding can't reveal anything behind it: */
+  rect->x1 = MAX (left_a->x, left_b->x) + 0.5;
+  rect->x2 = MIN (right_a->x, right_b->x) - 0.5;
+  rect->y1 = MAX (top_a->y, top_b->y) + 0.5;
+  rect->y2 = MIN (bottom_a->y, bottom_b->y) - 0.5;
+  if (rect->x1 >= rect->x2 || rect->y1 >= rect->y2)
+    return FALSE;
+
+  /* This is only right if the edges are roughly upright and level: */
+  return point_in_quad (vertices, rect->x1, rect->y1) &&
+    point_in_quad (vertices, rect->x2, rect->y1) &&
+    point_in_quad (vertices, rect->x1, rect->y2) &&
+    point_in_quad (vertices, rect->x2, rect->y2);
+}
+
+/* Mark the children that are completely hidden by occluders in front of them,
+ * and return how many there are:
+ */
+static guint
+example_carousel_group_find_occluded (ExampleCarouselGroup *group)
+{
+  ScreenRect occluders[MAX_OCCLUDERS];
+  guint n_occluders = 0;
+  guint n_culled = 0;
+
+  /* From the front to the back: */
+  guint i = group->children->len;
+  while (i > 0)
+  {
+    --i;
+    group->culled[i] = FALSE;
+
+    ClutterActor *child = g_ptr_array_index (group->children, i);
+    if (!CLUTTER_ACTOR_IS_VISIBLE (child))
+      continue;
+
+    ClutterVertex vertices[4];
+    clutter_actor_get_abs_allocation_vertices (child, vertices);
+
+    ScreenRect bounds = { vertices[0].x, vertices[0].y, vertices[0].x, vertices[0].y };
+    guint v = 0;
+    for (v = 1; v < 4; ++v)
+    {
+      bounds.x1 = MIN (bounds.x1, vertices[v].x);
+      bounds.y1 = MIN (bounds.y1, vertices[v].y);
+      bounds.x2 = MAX (bounds.x2, vertices[v].x);
+      bounds.y2 = MAX (bounds.y2, vertices[v].y);
+    }
+
+    guint k = 0;
+    for (k = 0; k < n_occluders; ++k)
+    {
+      if (bounds.x1 >= occluders[k].x1 && bounds.x2 <= occluders[k].x2 &&
+          bounds.y1 >= occluders[k].y1 && bounds.y2 <= occluders[k].y2)
+      {
+        group->culled[i] = TRUE;
+        ++n_culled;
+        break;
+      }
+    }
+
+    if (!group->culled[i] && n_occluders < MAX_OCCLUDERS &&
+        g_hash_table_lookup (group->occluders, child) &&
+        clutter_actor_get_paint_opacity (child) == 0xff &&
+        get_inner_rect (vertices, &occluders[n_occluders]))
+      ++n_occluders;
+  }
+
+  return n_culled;
+}
+
+static void
+example_carousel_group_paint_children (ExampleCarouselGroup *group, gboolean picking)
+{
+  example_carousel_group_sort_depth_order (group);
+
+  const guint n_children = group->children->len;
+  guint n_culled = 0;
+  if (group->cull_occluded)
+    n_culled = example_carousel_group_find_occluded (group);
+
+  /* Only count the culled children for painting, not for picking: */
+  if (!picking)
+  {
+    group->n_culled = n_culled;
+    g_hash_table_remove_all (group->culled_children);
+  }
+
+  guint i = 0;
+  for (i = 0; i < n_children; ++i)
+  {
+    ClutterActor *child = g_ptr_array_index (group->children, i);
+    if (n_culled && group->culled[i])
+    {
+      if (!picking)
+        g_hash_table_insert (group->culled_children, child, child);
+    }
+    else if (CLUTTER_ACTOR_IS_VISIBLE (child))
+      clutter_actor_paint (child);
+  }
+}
+
+/* An implementation for the ClutterActor::paint() vfunc: */
+static void
+example_carousel_group_paint (ClutterActor *actor)
+{
+  example_carousel_group_paint_children (EXAMPLE_CAROUSEL_GROUP (actor), FALSE);
+}
+
+/* An implementation for the ClutterActor::pick() vfunc: */
+static void
+example_carousel_group_pick (ClutterActor *actor, const ClutterColor *color)
+{
+  /* Pick the group itself, if it is reactive: */
+  CLUTTER_ACTOR_CLASS (example_carousel_group_parent_class)->pick (actor, color);
+
+  /* Painting the children picks them instead, while picking: */
+  example_carousel_group_paint_children (EXAMPLE_CAROUSEL_GROUP (actor), TRUE);
+}
+
+/* The right and bottom edges of the children: */
+static void
+example_carousel_group_get_extents (ExampleCarouselGroup *group, gfloat *width, gfloat *height)
+{
+  gfloat max_right = 0;
+  gfloat max_bottom = 0;
+
+  guint i = 0;
+  for (i = 0; i < group->children->len; ++i)
+  {
+    ClutterActor *child = g_ptr_array_index (group->children, i);
+
+    gfloat child_width = 0;
+    gfloat child_height = 0;
+    clutter_actor_get_preferred_size (child, NULL, NULL, &child_width, &child_height);
+
+    max_right = MAX (max_right, clutter_actor_get_x (child) + child_width);
+    max_bottom = MAX (max_bottom, clutter_actor_get_y (child) + child_height);
+  }
+
+  if (width)
+    *width = max_right;
+  if (height)
+    *height = max_bottom;
+}
+
+/* An implementation for the ClutterActor::get_preferred_width() vfunc: */
+static void
+example_carousel_group_get_preferred_width (ClutterActor *actor,
+                                            gfloat for_height G_GNUC_UNUSED,
+                                            gfloat *min_width_p,
+                                            gfloat *natural_width_p)
+{
+  gfloat width = 0;
+  example_carousel_group_get_extents (EXAMPLE_CAROUSEL_GROUP (actor), &width, NULL);
+
+  if (min_width_p)
+    *min_width_p = 0;
+  if (natural_width_p)
+    *natural_width_p = width;
+}
+
+/* An implementation for the ClutterActor::get_preferred_height() vfunc: */
+static void
+example_carousel_group_get_preferred_height (ClutterActor *actor,
+                                             gfloat for_width G_GNUC_UNUSED,
+                                             gfloat *min_height_p,
+                                             gfloat *natural_height_p)
+{
+  gfloat height = 0;
+  example_carousel_group_get_extents (EXAMPLE_CAROUSEL_GROUP (actor), NULL, &height);
+
+  if (min_height_p)
+    *min_height_p = 0;
+  if (natural_height_p)
+    *natural_height_p = height;
+}
+
+/* An implementation for the ClutterActor::allocate() vfunc.
+ * Like ClutterGroup, the children keep their positions and preferred sizes:
+ */
+static void
+example_carousel_group_allocate (ClutterActor *actor, const ClutterActorBox *box,
+  ClutterAllocationFlags flags)
+{
+  ExampleCarouselGroup *group = EXAMPLE_CAROUSEL_GROUP (actor);
+
+  CLUTTER_ACTOR_CLASS (example_carousel_group_parent_class)->allocate (actor, box, flags);
+
+  guint i = 0;
+  for (i = 0; i < group->children->len; ++i)
+    clutter_actor_allocate_preferred_size (g_ptr_array_index (group->children, i), flags);
+}
+
+static void
+example_carousel_group_dispose (GObject *object)
+{
+  ExampleCarouselGroup *group = EXAMPLE_CAROUSEL_GROUP (object);
+
+  /* Destroying a child removes it from the group: */
+  while (group->children->len)
+    clutter_actor_destroy (g_ptr_array_index (group->children, group->children->len - 1));
+
+  G_OBJECT_CLASS (example_carousel_group_parent_class)->dispose (object);
+}
+
+static void
+example_carousel_group_finalize (GObject *object)
+{
+  ExampleCarouselGroup *group = EXAMPLE_CAROUSEL_GROUP (object);
+
+  g_ptr_array_free (group->children, TRUE);
+  g_free (group->depths);
+  g_free (group->culled);
+  g_hash_table_destroy (group->occluders);
+  g_hash_table_destroy (group->culled_children);
+
+  G_OBJECT_CLASS (example_carousel_group_parent_class)->finalize (object);
+}
+
+static void
+example_carousel_group_class_init (ExampleCarouselGroupClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  ClutterActorClass *actor_class = CLUTTER_ACTOR_CLASS (klass);
+
+  /* Provide implementations for ClutterActor vfuncs: */
+  actor_class->paint = example_carousel_group_paint;
+  actor_class->pick = example_carousel_group_pick;
+  actor_class->get_preferred_width = example_carousel_group_get_preferred_width;
+  actor_class->get_preferred_height = example_carousel_group_get_preferred_height;
+  actor_class->allocate = example_carousel_group_allocate;
+
+  gobject_class->dispose = example_carousel_group_dispose;
+  gobject_class->finalize = example_carousel_group_finalize;
+}
+
+static void
+example_carousel_group_init (ExampleCarouselGroup *group)
+{
+  group->children = g_ptr_array_new ();
+  group->depths = NULL;
+  group->culled = NULL;
+  group->n_allocated = 0;
+  group->needs_sort = FALSE;
+  group->occluders = g_hash_table_new (g_direct_hash, g_direct_equal);
+  group->cull_occluded = FALSE;
+  group->n_culled = 0;
+  group->culled_children = g_hash_table_new (g_direct_hash, g_direct_equal);
+}
+
+ClutterActor *
+example_carousel_group_new (void)
+{
+  return g_object_new (EXAMPLE_TYPE_CAROUSEL_GROUP, NULL);
+}
+
+void
+example_carousel_group_set_cull_occluded (ExampleCarouselGroup *group, gboolean cull_occluded)
+{
+  g_return_if_fail (EXAMPLE_IS_CAROUSEL_GROUP (group));
+
+  group->cull_occluded = cull_occluded;
+  group->n_culled = 0;
+  g_hash_table_remove_all (group->culled_children);
+  clutter_actor_queue_redraw (CLUTTER_ACTOR (group));
+}
+
+void
+example_carousel_group_set_occluder (ExampleCarouselGroup *group, ClutterActor *child,
+  gboolean occluder)
+{
+  g_return_if_fail (EXAMPLE_IS_CAROUSEL_GROUP (group));
+
+  if (occluder)
+    g_hash_table_insert (group->occluders, child, child);
+  else
+    g_hash_table_remove (group->occluders, child);
+}
+
+guint
+example_carousel_group_get_n_culled (ExampleCarouselGroup *group)
+{
+  g_return_val_if_fail (EXAMPLE_IS_CAROUSEL_GROUP (group), 0);
+
+  return group->n_culled;
+}
+
+gboolean
+example_carousel_group_get_child_culled (ExampleCarouselGroup *group, ClutterActor *child)
+{
+  g_return_val_if_fail (EXAMPLE_IS_CAROUSEL_GROUP (group), FALSE);
+
+  return g_hash_table_lookup (group->culled_children, child) != NULL;
+}
@@ -0,0 +1,114 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef __EXAMPLE_CAROUSEL_GROUP_H__
+#define __EXAMPLE_CAROUSEL_GROUP_H__
+
+#include <clutter/clutter.h>
+
+G_BEGIN_DECLS
+
+#define EXAMPLE_TYPE_CAROUSEL_GROUP                (example_carousel_group_get_type ())
+#define EXAMPLE_CAROUSEL_GROUP(obj)                (G_TYPE_CHECK_INSTANCE_CAST ((obj), EXAMPLE_TYPE_CAROUSEL_GROUP, ExampleCarouselGroup))
+#define EXAMPLE_IS_CAROUSEL_GROUP(obj)             (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EXAMPLE_TYPE_CAROUSEL_GROUP))
+#define EXAMPLE_CAROUSEL_GROUP_CLASS(klass)        (G_TYPE_CHECK_CLASS_CAST ((klass), EXAMPLE_TYPE_CAROUSEL_GROUP, ExampleCarouselGroupClass))
+#define EXAMPLE_IS_CAROUSEL_GROUP_CLASS(klass)     (G_TYPE_CHECK_CLASS_TYPE ((klass), EXAMPLE_TYPE_CAROUSEL_GROUP))
+#define EXAMPLE_CAROUSEL_GROUP_GET_CLASS(obj)      (G_TYPE_INSTANCE_GET_CLASS ((obj), EXAMPLE_TYPE_CAROUSEL_GROUP, ExampleCarouselGroupClass))
+
+typedef struct _ExampleCarouselGroup       ExampleCarouselGroup;
+typedef struct _ExampleCarouselGroupClass  ExampleCarouselGroupClass;
+
+/* A container, like ClutterGroup, that paints its children from the back to
+ * the front. ClutterGroup sorts all its children again whenever the depth of
+ * any of them changes, so moving n children costs n full sorts.
+ * This group just remembers that the order has changed, and sorts once before
+ * it is next painted or picked, starting from the previous order.
+ * The children of a carousel only move a little in each frame, so that order
+ * is nearly right, and an insertion sort fixes it in roughly linear time.
+ *
+ * It can also skip painting children that are completely hidden behind
+ * children that are marked as opaque occluders.
+ */
+struct _ExampleCarouselGroup
+{
+  /*< private >*/
+  ClutterActor parent_instance;
+
+  /* The children, from the back to the front when needs_sort is FALSE: */
+  GPtrArray *children;
+
+  /* The depths of the children, in the same order, used while sorting,
+   * and whether they are hidden behind other children, used while painting:
+   */
+  gfloat *depths;
+  gboolean *culled;
+  guint n_allocated;
+
+  gboolean needs_sort;
+
+  /* The children that hide whatever is behind them, when they are fully opaque: */
+  GHashTable *occluders;
+  gboolean cull_occluded;
+  guint n_culled;
+
+  /* The children that were not painted in the last frame: */
+  GHashTable *culled_children;
+};
+
+struct _ExampleCarouselGroupClass
+{
+  /*< private >*/
+  ClutterActorClass parent_class;
+};
+
+
+GType example_carousel_group_get_type (void) G_GNUC_CONST;
+
+ClutterActor *example_carousel_group_new (void);
+
+/* Sort the children by their depths now, if any have changed,
+ * instead of waiting until the group is painted.
+ */
+void example_carousel_group_sort_depth_order (ExampleCarouselGroup *group);
+
+/* Whether to skip painting children that are completely hidden by occluders
+ * in front of them. This is off by default, because finding them costs
+ * some time in each frame, which is only worth it if they are expensive to paint.
+ */
+void example_carousel_group_set_cull_occluded (ExampleCarouselGroup *group, gboolean cull_occluded);
+
+/* Whether the child hides what is behind it, wherever it is painted,
+ * while its paint opacity is 255. For instance, an image without transparency.
+ * This may be set before the child is added, and is forgotten when it is removed.
+ */
+void example_carousel_group_set_occluder (ExampleCarouselGroup *group,
+                                          ClutterActor         *child,
+                                          gboolean              occluder);
+
+/* The number of children that were not painted in the last frame,
+ * because they were hidden behind occluders.
+ */
+guint example_carousel_group_get_n_culled (ExampleCarouselGroup *group);
+
+/* Whether the child was not painted in the last frame,
+ * because it was hidden behind occluders.
+ */
+gboolean example_carousel_group_get_child_culled (ExampleCarouselGroup *group,
+                                                  ClutterActor         *child);
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_CAROUSEL_GROUP_H__ */
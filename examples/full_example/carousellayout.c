@@ -0,0 +1,317 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "carousellayout.h"
+
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+struct _CarouselLayout
+{
+  gfloat center_x;
+  gfloat center_y;
+  gfloat radius_x;
+  gfloat radius_z;
+
+  guint n_items;
+  guint n_allocated;
+
+  /* Added to all the angles, in radians: */
+  gfloat offset;
+
+  /* Each array has n_allocated elements, which is at least n_items rounded
+   * up to a multiple of 4, so we can always calculate 4 at a time.
+   * The angles are in radians, and already have the ellipse's own
+   * -90 degrees offset added, like ClutterBehaviourEllipse's angles.
+   */
+  gfloat *angles;
+  gfloat *x;
+  gfloat *depth;
+};
+
+/* The coefficients of the Taylor series for sin() and cos(),
+ * which are accurate enough between -pi/2 and pi/2:
+ */
+#define SIN_C3  (-1.0f / 6.0f)
+#define SIN_C5  ( 1.0f / 120.0f)
+#define SIN_C7  (-1.0f / 5040.0f)
+#define SIN_C9  ( 1.0f / 362880.0f)
+#define COS_C2  (-1.0f / 2.0f)
+#define COS_C4  ( 1.0f / 24.0f)
+#define COS_C6  (-1.0f / 720.0f)
+#define COS_C8  ( 1.0f / 40320.0f)
+#define COS_C10 (-1.0f / 3628800.0f)
+
+#define LAYOUT_PI     3.14159265358979f
+#define LAYOUT_TWO_PI (2.0f * LAYOUT_PI)
+
+static void
+sincos_scalar (gfloat angle, gfloat *sin_result, gfloat *cos_result)
+{
+  /* Bring the angle into [-pi, pi]: */
+  gfloat turns = angle * (1.0f / LAYOUT_TWO_PI);
+  turns -= floorf (turns + 0.5f);
+  gfloat x = turns * LAYOUT_TWO_PI;
+
+  /* And then into [-pi/2, pi/2], where sin() stays the same
+   * but cos() changes its sign:
+   */
+  gfloat cos_sign = 1.0f;
+  if (x > LAYOUT_PI / 2)
+  {
+    x = LAYOUT_PI - x;
+    cos_sign = -1.0f;
+  }
+  else if (x < -LAYOUT_PI / 2)
+  {
+    x = -LAYOUT_PI - x;
+    cos_sign = -1.0f;
+  }
+
+  const gfloat x2 = x * x;
+  *sin_result = x * (1.0f + x2 * (SIN_C3 + x2 * (SIN_C5 + x2 * (SIN_C7 + x2 * SIN_C9))));
+  *cos_result = cos_sign *
+    (1.0f + x2 * (COS_C2 + x2 * (COS_C4 + x2 * (COS_C6 + x2 * (COS_C8 + x2 * COS_C10)))));
+}
+
+#ifdef __SSE2__
+/* The same as sincos_scalar(), for 4 angles at once: */
+static void
+sincos_sse2 (__m128 angle, __m128 *sin_result, __m128 *cos_result)
+{
+  const __m128 sign_mask = _mm_set1_ps (-0.0f);
+  const __m128 pi = _mm_set1_ps (LAYOUT_PI);
+
+  /* Bring the angles into [-pi, pi].
+   * _mm_cvtps_epi32() rounds to the nearest integer:
+   */
+  __m128 turns = _mm_mul_ps (angle, _mm_set1_ps (1.0f / LAYOUT_TWO_PI));
+  turns = _mm_sub_ps (turns, _mm_cvtepi32_ps (_mm_cvtps_epi32 (turns)));
+  __m128 x = _mm_mul_ps (turns, _mm_set1_ps (LAYOUT_TWO_PI));
+
+  /* And then into [-pi/2, pi/2], by replacing x with (+/-pi - x): */
+  const __m128 sign = _mm_and_ps (x, sign_mask);
+  const __m128 abs_x = _mm_andnot_ps (sign_mask, x);
+  const __m128 fold = _mm_cmpgt_ps (abs_x, _mm_set1_ps (LAYOUT_PI / 2));
+  const __m128 folded = _mm_sub_ps (_mm_or_ps (pi, sign), x);
+  x = _mm_or_ps (_mm_and_ps (fold, folded), _mm_andnot_ps (fold, x));
+  const __m128 cos_sign = _mm_and_ps (fold, sign_mask);
+
+  const __m128 x2 = _mm_mul_ps (x, x);
+
+  __m128 s = _mm_set1_ps (SIN_C9);
+  s = _mm_add_ps (_mm_mul_ps (s, x2), _mm_set1_ps (SIN_C7));
+  s = _mm_add_ps (_mm_mul_ps (s, x2), _mm_set1_ps (SIN_C5));
+  s = _mm_add_ps (_mm_mul_ps (s, x2), _mm_set1_ps (SIN_C3));
+  s = _mm_add_ps (_mm_mul_ps (s, x2), _mm_set1_ps (1.0f));
+  *sin_result = _mm_mul_ps (s, x);
+
+  __m128 c = _mm_set1_ps (COS_C10);
+  c = _mm_add_ps (_mm_mul_ps (c, x2), _mm_set1_ps (COS_C8));
+  c = _mm_add_ps (_mm_mul_ps (c, x2), _mm_set1_ps (COS_C6));
+  c = _mm_add_ps (_mm_mul_ps (c, x2), _mm_set1_ps (COS_C4));
+  c = _mm_add_ps (_mm_mul_ps (c, x2), _mm_set1_ps (COS_C2));
+  c = _mm_add_ps (_mm_mul_ps (c, x2), _mm_set1_ps (1.0f));
+  *cos_result = _mm_xor_ps (c, cos_sign);
+}
+#endif /* __SSE2__ */
+
+CarouselLayout*
+carousel_layout_new (gfloat center_x, gfloat center_y, gfloat width, gfloat height)
+{
+  CarouselLayout *layout = g_new0 (CarouselLayout, 1);
+  layout->center_x = center_x;
+  layout->center_y = center_y;
+  layout->radius_x = width / 2;
+  layout->radius_z = height / 2;
+
+  return layout;
+}
+
+void
+carousel_layout_free (CarouselLayout *layout)
+{
+  g_return_if_fail (layout);
+
+  g_free (layout->angles);
+  g_free (layout->x);
+  g_free (layout->depth);
+  g_free (layout);
+}
+
+void
+carousel_layout_set_n_items (CarouselLayout *layout, guint n_items)
+{
+  g_return_if_fail (layout);
+
+  guint n_allocated = (n_items + 3) & ~3u;
+  if (n_allocated > layout->n_allocated)
+  {
+    n_allocated = MAX (n_allocated, layout->n_allocated * 2);
+
+    layout->angles = g_renew (gfloat, layout->angles, n_allocated);
+    layout->x = g_renew (gfloat, layout->x, n_allocated);
+    layout->depth = g_renew (gfloat, layout->depth, n_allocated);
+    layout->n_allocated = n_allocated;
+  }
+
+  guint i = 0;
+  for (i = layout->n_items; i < layout->n_allocated; ++i)
+  {
+    layout->angles[i] = -LAYOUT_PI / 2;
+    layout->x[i] = layout->center_x;
+    layout->depth[i] = 0;
+  }
+
+  layout->n_items = n_items;
+}
+
+guint
+carousel_layout_get_n_items (CarouselLayout *layout)
+{
+  g_return_val_if_fail (layout, 0);
+
+  return layout->n_items;
+}
+
+void
+carousel_layout_set_angle (CarouselLayout *layout, guint index, gdouble angle)
+{
+  g_return_if_fail (layout);
+  g_return_if_fail (index < layout->n_items);
+
+  layout->angles[index] = (angle - 90) * (G_PI / 180.0);
+}
+
+void
+carousel_layout_set_offset (CarouselLayout *layout, gdouble offset)
+{
+  g_return_if_fail (layout);
+
+  layout->offset = offset * (G_PI / 180.0);
+}
+
+static void
+carousel_layout_update_range_scalar (CarouselLayout *layout, gdouble rotation,
+  guint first, guint n_items)
+{
+  const gfloat offset = rotation * (G_PI / 180.0) + layout->offset;
+
+  guint i = 0;
+  for (i = first; i < first + n_items; ++i)
+  {
+    gfloat sin_angle = 0, cos_angle = 0;
+    sincos_scalar (layout->angles[i] + offset, &sin_angle, &cos_angle);
+
+    layout->x[i] = layout->center_x + layout->radius_x * cos_angle;
+    layout->depth[i] = layout->radius_z * sin_angle;
+  }
+}
+
+void
+carousel_layout_update_scalar (CarouselLayout *layout, gdouble rotation)
+{
+  g_return_if_fail (layout);
+
+  carousel_layout_update_range_scalar (layout, rotation, 0, layout->n_items);
+}
+
+void
+carousel_layout_update (CarouselLayout *layout, gdouble rotation)
+{
+  g_return_if_fail (layout);
+
+  carousel_layout_update_range (layout, rotation, 0, layout->n_items);
+}
+
+void
+carousel_layout_update_range (CarouselLayout *layout, gdouble rotation,
+  guint first, guint n_items)
+{
+  g_return_if_fail (layout);
+  g_return_if_fail (first + n_items <= layout->n_items);
+
+#ifdef __SSE2__
+  const __m128 offset = _mm_set1_ps (rotation * (G_PI / 180.0) + layout->offset);
+  const __m128 center_x = _mm_set1_ps (layout->center_x);
+  const __m128 radius_x = _mm_set1_ps (layout->radius_x);
+  const __m128 radius_z = _mm_set1_ps (layout->radius_z);
+
+  /* The padding at the end of the arrays is calculated too,
+   * which is harmless:
+   */
+  guint i = 0;
+  for (i = first & ~3u; i < first + n_items; i += 4)
+  {
+    const __m128 angle = _mm_add_ps (_mm_loadu_ps (layout->angles + i), offset);
+
+    __m128 sin_angle, cos_angle;
+    sincos_sse2 (angle, &sin_angle, &cos_angle);
+
+    _mm_storeu_ps (layout->x + i, _mm_add_ps (center_x, _mm_mul_ps (radius_x, cos_angle)));
+    _mm_storeu_ps (layout->depth + i, _mm_mul_ps (radius_z, sin_angle));
+  }
+#else
+  carousel_layout_update_range_scalar (layout, rotation, first, n_items);
+#endif
+}
+
+void
+carousel_layout_apply (CarouselLayout *layout, ClutterActor **actors)
+{
+  g_return_if_fail (layout);
+
+  carousel_layout_apply_range (layout, actors, 0, layout->n_items);
+}
+
+void
+carousel_layout_apply_range (CarouselLayout *layout, ClutterActor **actors,
+  guint first, guint n_items)
+{
+  g_return_if_fail (layout);
+  g_return_if_fail (first + n_items <= layout->n_items);
+
+  const gfloat y = layout->center_y;
+
+  guint i = 0;
+  for (i = first; i < first + n_items; ++i)
+  {
+    ClutterActor *actor = actors[i];
+    if (!actor)
+      continue;
+
+    clutter_actor_set_position (actor, layout->x[i], y);
+    clutter_actor_set_depth (actor, layout->depth[i]);
+  }
+}
+
+void
+carousel_layout_get_position (CarouselLayout *layout, guint index,
+  gfloat *x, gfloat *y, gfloat *depth)
+{
+  g_return_if_fail (layout);
+  g_return_if_fail (index < layout->n_items);
+
+  if (x)
+    *x = layout->x[index];
+  if (y)
+    *y = layout->center_y;
+  if (depth)
+    *depth = layout->depth[index];
+}
@@ -0,0 +1,95 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef __EXAMPLE_CAROUSEL_LAYOUT_H__
+#define __EXAMPLE_CAROUSEL_LAYOUT_H__
+
+#include <clutter/clutter.h>
+
+G_BEGIN_DECLS
+
+/* Calculates the positions of all the items on a tilted ellipse at once,
+ * as ClutterBehaviourEllipse would with a tilt of -90 degrees around the
+ * x axis, so that an angle of 180 is at the front.
+ * The angles, positions and depths are kept in separate arrays, so that
+ * they can be calculated four at a time with SSE2, where that is available.
+ */
+typedef struct _CarouselLayout CarouselLayout;
+
+CarouselLayout *carousel_layout_new (gfloat center_x,
+                                     gfloat center_y,
+                                     gfloat width,
+                                     gfloat height);
+void            carousel_layout_free (CarouselLayout *layout);
+
+/* New items have an angle of 0. The arrays grow geometrically,
+ * so adding a few items at a time doesn't copy them each time.
+ */
+void            carousel_layout_set_n_items (CarouselLayout *layout,
+                                             guint           n_items);
+guint           carousel_layout_get_n_items (CarouselLayout *layout);
+
+/* The angle, in degrees, that the item has when the rotation is 0. */
+void            carousel_layout_set_angle (CarouselLayout *layout,
+                                           guint           index,
+                                           gdouble         angle);
+
+/* An angle, in degrees, that is added to all the items' angles, so that they
+ * can all be turned at once without setting each one's angle again.
+ */
+void            carousel_layout_set_offset (CarouselLayout *layout,
+                                            gdouble         offset);
+
+/* Calculate the positions of all the items, with this rotation,
+ * in degrees, and the offset added to their angles.
+ */
+void            carousel_layout_update (CarouselLayout *layout,
+                                        gdouble         rotation);
+
+/* Like carousel_layout_update(), but only for n_items items from first,
+ * such as those that have just been added. A few before them may be
+ * calculated too, so that they can still be calculated four at a time.
+ */
+void            carousel_layout_update_range (CarouselLayout *layout,
+                                              gdouble         rotation,
+                                              guint           first,
+                                              guint           n_items);
+
+/* Like carousel_layout_update(), but without SSE2, for comparison. */
+void            carousel_layout_update_scalar (CarouselLayout *layout,
+                                               gdouble         rotation);
+
+/* Move the actors to the positions from the last update.
+ * actors has one actor for each item. NULL actors are skipped.
+ */
+void            carousel_layout_apply (CarouselLayout  *layout,
+                                       ClutterActor   **actors);
+
+/* Like carousel_layout_apply(), but only for n_items actors from first. */
+void            carousel_layout_apply_range (CarouselLayout  *layout,
+                                             ClutterActor   **actors,
+                                             guint            first,
+                                             guint            n_items);
+
+void            carousel_layout_get_position (CarouselLayout *layout,
+                                              guint           index,
+                                              gfloat         *x,
+                                              gfloat         *y,
+                                              gfloat         *depth);
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_CAROUSEL_LAYOUT_H__ */
@@ -0,0 +1,545 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "dirscanner.h"
+
+#include <clutter/clutter.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+/* A worker hands its files over when it has found this many,
+ * or when it runs out of directories to scan:
+ */
+#define FILES_PER_BATCH 256
+
+/* How often the main loop takes the files that have been found,
+ * in milliseconds:
+ */
+#define DELIVERY_INTERVAL 100
+
+/* How often it checks until the first files have been found, so that they
+ * can be shown at once, however many there are to find, and while more
+ * files are waiting than it hands over at once:
+ */
+#define QUICK_DELIVERY_INTERVAL 10
+
+/* The most files that the main loop takes at once, so that adding them
+ * doesn't stop it for long. This is a multiple of FILES_PER_BATCH:
+ */
+#define MAX_FILES_PER_DELIVERY (8 * FILES_PER_BATCH)
+
+typedef struct _DirScannerWorker
+{
+  DirScanner *scanner;
+  GThread *thread;
+
+  /* The directories that this worker has found but not yet scanned,
+   * the newest at the tail. Other workers steal from the head.
+   */
+  GMutex *mutex;
+  GQueue directories;
+
+  /* The files (DirScannerFiles) that have not been handed over yet: */
+  GArray *files;
+}
+DirScannerWorker;
+
+struct _DirScanner
+{
+  DirScannerFilesFunc files_func;
+  DirScannerDoneFunc done_func;
+  gpointer user_data;
+
+  DirScannerWorker *workers;
+  guint n_workers;
+  guint n_threads;
+  guint delivery_source_id;
+  guint delivery_interval;
+
+  /* Whether any files have been handed over yet. Until then, the workers
+   * hand over their files after each directory, instead of in full batches:
+   */
+  gint delivered;
+
+  /* Stolen directories are counted without the lock: */
+  gint n_steals;
+
+  /* Protects everything below, and is held while directories are added
+   * to the workers' queues, so that idle workers can wait on cond
+   * for new directories, or for the end of the scan:
+   */
+  GMutex *mutex;
+  GCond *cond;
+  gboolean cancelled;
+
+  /* The directories that are queued or being scanned.
+   * The scan has finished when there are none:
+   */
+  guint n_pending_directories;
+  guint n_running_workers;
+
+  /* The batches of files (GArrays of DirScannerFiles) for the main loop: */
+  GPtrArray *batches;
+
+  guint64 n_entries;
+  guint n_directories;
+  guint n_skipped_files[IMAGE_SNIFF_N_RESULTS];
+  GTimer *timer; /* Stopped when the scan has finished. */
+};
+
+static gint
+get_processor_count (void)
+{
+  const long count = sysconf (_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (gint)count : 1;
+}
+
+static gboolean
+get_is_directory (const struct dirent *entry, const gchar *path)
+{
+#ifdef _DIRENT_HAVE_D_TYPE
+  /* Most file systems tell us without a stat(): */
+  if (entry->d_type != DT_UNKNOWN)
+    return entry->d_type == DT_DIR;
+#endif
+
+  /* lstat() so that we don't follow links to directories: */
+  struct stat file_info;
+  return lstat (path, &file_info) == 0 && S_ISDIR (file_info.st_mode);
+}
+
+/* Give the worker's files to the main loop: */
+static void
+dir_scanner_worker_flush (DirScannerWorker *worker)
+{
+  if (!worker->files->len)
+    return;
+
+  DirScanner *scanner = worker->scanner;
+  g_mutex_lock (scanner->mutex);
+  g_ptr_array_add (scanner->batches, worker->files);
+  g_mutex_unlock (scanner->mutex);
+
+  worker->files = g_array_sized_new (FALSE, FALSE, sizeof (DirScannerFile), FILES_PER_BATCH);
+}
+
+/* Take the newest directory from the worker's own queue, or else the oldest
+ * directory from another worker's queue. Returns NULL if all the queues
+ * are empty.
+ */
+static gchar*
+dir_scanner_worker_take (DirScannerWorker *worker)
+{
+  g_mutex_lock (worker->mutex);
+  gchar *path = (gchar*)g_queue_pop_tail (&worker->directories);
+  g_mutex_unlock (worker->mutex);
+  if (path)
+    return path;
+
+  DirScanner *scanner = worker->scanner;
+  const guint index = worker - scanner->workers;
+  guint i = 0;
+  for (i = 1; i < scanner->n_workers; ++i)
+  {
+    DirScannerWorker *victim = &scanner->workers[(index + i) % scanner->n_workers];
+    g_mutex_lock (victim->mutex);
+    path = (gchar*)g_queue_pop_head (&victim->directories);
+    g_mutex_unlock (victim->mutex);
+
+    if (path)
+    {
+      g_atomic_int_inc (&scanner->n_steals);
+      return path;
+    }
+  }
+
+  return NULL;
+}
+
+/* This must be called with the scanner's lock held: */
+static gboolean
+dir_scanner_has_queued_directories (DirScanner *scanner)
+{
+  guint i = 0;
+  for (i = 0; i < scanner->n_workers; ++i)
+  {
+    DirScannerWorker *worker = &scanner->workers[i];
+    g_mutex_lock (worker->mutex);
+    const gboolean has_queued = !g_queue_is_empty (&worker->directories);
+    g_mutex_unlock (worker->mutex);
+
+    if (has_queued)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+static void
+dir_scanner_worker_scan (DirScannerWorker *worker, const gchar *directory_path)
+{
+  DirScanner *scanner = worker->scanner;
+  GPtrArray *subdirectories = g_ptr_array_new ();
+  guint n_entries = 0;
+  guint n_skipped_files[IMAGE_SNIFF_N_RESULTS] = { 0 };
+
+  DIR *dir = opendir (directory_path);
+  if (!dir)
+    g_warning ("opendir() failed for %s: %s\n", directory_path, g_strerror (errno));
+
+  struct dirent *entry = NULL;
+  while (dir && !g_atomic_int_get (&scanner->cancelled) && (entry = readdir (dir)))
+  {
+    const gchar *name = entry->d_name;
+    if (strcmp (name, ".") == 0 || strcmp (name, "..") == 0)
+      continue;
+
+    ++n_entries;
+    gchar *path = g_build_filename (directory_path, name, NULL);
+    if (get_is_directory (entry, path))
+    {
+      g_ptr_array_add (subdirectories, path);
+      continue;
+    }
+
+    /* Check that it is an image here, rather than in the main loop: */
+    DirScannerFile file = { path, 0, 0 };
+    const ImageSniffResult result =
+      image_sniffer_check_file_stat (path, NULL, &file.file_size, &file.file_mtime);
+    if (result != IMAGE_SNIFF_OK)
+    {
+      ++n_skipped_files[result];
+      g_free (path);
+      continue;
+    }
+
+    g_array_append_val (worker->files, file);
+    if (worker->files->len >= FILES_PER_BATCH)
+      dir_scanner_worker_flush (worker);
+  }
+
+  if (dir)
+    closedir (dir);
+
+  if (!g_atomic_int_get (&scanner->delivered))
+    dir_scanner_worker_flush (worker);
+
+  /* Queue the subdirectories, and count them as pending, before this
+   * directory stops being pending, so that the count cannot reach 0
+   * while there is still something to scan:
+   */
+  g_mutex_lock (scanner->mutex);
+  scanner->n_entries += n_entries;
+  ++scanner->n_directories;
+  guint i = 0;
+  for (i = 0; i < IMAGE_SNIFF_N_RESULTS; ++i)
+    scanner->n_skipped_files[i] += n_skipped_files[i];
+  scanner->n_pending_directories += subdirectories->len;
+
+  g_mutex_lock (worker->mutex);
+  for (i = 0; i < subdirectories->len; ++i)
+    g_queue_push_tail (&worker->directories, g_ptr_array_index (subdirectories, i));
+  g_mutex_unlock (worker->mutex);
+
+  --scanner->n_pending_directories;
+  if (subdirectories->len || !scanner->n_pending_directories)
+    g_cond_broadcast (scanner->cond);
+  g_mutex_unlock (scanner->mutex);
+
+  /* The queue owns the paths now: */
+  g_ptr_array_free (subdirectories, TRUE);
+}
+
+static gpointer
+dir_scanner_worker_run (gpointer data)
+{
+  DirScannerWorker *worker = (DirScannerWorker*)data;
+  DirScanner *scanner = worker->scanner;
+
+  while (TRUE)
+  {
+    gchar *path = dir_scanner_worker_take (worker);
+    if (path)
+    {
+      dir_scanner_worker_scan (worker, path);
+      g_free (path);
+      continue;
+    }
+
+    /* Hand over what we have found while we wait for more directories: */
+    dir_scanner_worker_flush (worker);
+
+    g_mutex_lock (scanner->mutex);
+    while (!scanner->cancelled && scanner->n_pending_directories &&
+           !dir_scanner_has_queued_directories (scanner))
+      g_cond_wait (scanner->cond, scanner->mutex);
+
+    const gboolean finished = scanner->cancelled || !scanner->n_pending_directories;
+    if (finished)
+    {
+      --scanner->n_running_workers;
+      if (!scanner->n_running_workers)
+        g_timer_stop (scanner->timer);
+    }
+    g_mutex_unlock (scanner->mutex);
+
+    if (finished)
+      break;
+  }
+
+  return NULL;
+}
+
+static void
+dir_scanner_join (DirScanner *scanner)
+{
+  guint i = 0;
+  for (i = 0; i < scanner->n_workers; ++i)
+  {
+    DirScannerWorker *worker = &scanner->workers[i];
+    if (worker->thread)
+      g_thread_join (worker->thread);
+    worker->thread = NULL;
+  }
+}
+
+static void
+free_batch (GArray *batch)
+{
+  guint i = 0;
+  for (i = 0; i < batch->len; ++i)
+    g_free (g_array_index (batch, DirScannerFile, i).path);
+  g_array_free (batch, TRUE);
+}
+
+static void
+on_foreach_free_batch (gpointer data, gpointer user_data G_GNUC_UNUSED)
+{
+  free_batch ((GArray*)data);
+}
+
+/* This is called in the main loop, with the clutter lock held,
+ * because we use clutter_threads_add_timeout().
+ */
+static gboolean
+on_delivery_timeout (gpointer data)
+{
+  DirScanner *scanner = (DirScanner*)data;
+
+  /* Take the oldest batches, up to the limit, and check whether the workers
+   * have finished at the same time, so we know whether these are the last ones:
+   */
+  g_mutex_lock (scanner->mutex);
+  guint n_files = 0;
+  guint n_batches = 0;
+  while (n_batches < scanner->batches->len)
+  {
+    GArray *batch = (GArray*)g_ptr_array_index (scanner->batches, n_batches);
+    if (n_batches && n_files + batch->len > MAX_FILES_PER_DELIVERY)
+      break;
+
+    n_files += batch->len;
+    ++n_batches;
+  }
+
+  GPtrArray *batches = g_ptr_array_sized_new (n_batches);
+  guint i = 0;
+  for (i = 0; i < n_batches; ++i)
+    g_ptr_array_add (batches, g_ptr_array_index (scanner->batches, i));
+  g_ptr_array_remove_range (scanner->batches, 0, n_batches);
+
+  const gboolean more_waiting = scanner->batches->len > 0;
+  const gboolean finished = !scanner->n_running_workers && !more_waiting;
+  g_mutex_unlock (scanner->mutex);
+
+  /* Hand over the batches at once, so they can be added in bulk: */
+  if (n_files)
+  {
+    GArray *files = g_array_sized_new (FALSE, FALSE, sizeof (DirScannerFile), n_files);
+    for (i = 0; i < batches->len; ++i)
+    {
+      GArray *batch = (GArray*)g_ptr_array_index (batches, i);
+      g_array_append_vals (files, batch->data, batch->len);
+    }
+
+    scanner->files_func ((const DirScannerFile*)files->data, files->len, scanner->user_data);
+    g_array_free (files, TRUE);
+
+    g_atomic_int_set (&scanner->delivered, TRUE);
+  }
+
+  g_ptr_array_foreach (batches, on_foreach_free_batch, NULL);
+  g_ptr_array_free (batches, TRUE);
+
+  if (!finished)
+  {
+    /* Check often until the first files have been found, and while there
+     * are more than we hand over at once, and add the rest in bigger batches:
+     */
+    const guint interval = (g_atomic_int_get (&scanner->delivered) && !more_waiting) ?
+      DELIVERY_INTERVAL : QUICK_DELIVERY_INTERVAL;
+    if (interval == scanner->delivery_interval)
+      return TRUE; /* Call this again. */
+
+    scanner->delivery_interval = interval;
+    scanner->delivery_source_id = clutter_threads_add_timeout (interval,
+      on_delivery_timeout, scanner);
+    return FALSE; /* Don't call this again. */
+  }
+
+  /* The threads have finished, or are just about to: */
+  dir_scanner_join (scanner);
+  scanner->delivery_source_id = 0;
+
+  /* This may free the scanner: */
+  if (scanner->done_func)
+    scanner->done_func (scanner, scanner->user_data);
+
+  return FALSE; /* Don't call this again. */
+}
+
+DirScanner*
+dir_scanner_new (const gchar *directory_path, DirScannerFilesFunc files_func,
+  DirScannerDoneFunc done_func, gpointer user_data)
+{
+  g_return_val_if_fail (directory_path, NULL);
+  g_return_val_if_fail (files_func, NULL);
+
+  DirScanner *scanner = g_new0 (DirScanner, 1);
+  scanner->files_func = files_func;
+  scanner->done_func = done_func;
+  scanner->user_data = user_data;
+  scanner->mutex = g_mutex_new ();
+  scanner->cond = g_cond_new ();
+  scanner->batches = g_ptr_array_new ();
+  scanner->timer = g_timer_new ();
+
+  scanner->n_workers = get_processor_count ();
+  scanner->workers = g_new0 (DirScannerWorker, scanner->n_workers);
+
+  guint i = 0;
+  for (i = 0; i < scanner->n_workers; ++i)
+  {
+    DirScannerWorker *worker = &scanner->workers[i];
+    worker->scanner = scanner;
+    worker->mutex = g_mutex_new ();
+    g_queue_init (&worker->directories);
+    worker->files = g_array_sized_new (FALSE, FALSE, sizeof (DirScannerFile), FILES_PER_BATCH);
+  }
+
+  /* The first worker starts with the top directory, and the others
+   * steal from it:
+   */
+  g_queue_push_tail (&scanner->workers[0].directories, g_strdup (directory_path));
+  scanner->n_pending_directories = 1;
+
+  /* Hold the lock so that no worker can finish before they are all counted: */
+  g_mutex_lock (scanner->mutex);
+  for (i = 0; i < scanner->n_workers; ++i)
+  {
+    DirScannerWorker *worker = &scanner->workers[i];
+
+    GError *error = NULL;
+    worker->thread = g_thread_create (dir_scanner_worker_run, worker, TRUE, &error);
+    if (error)
+    {
+      g_warning ("g_thread_create() failed: %s\n", error->message);
+      g_clear_error (&error);
+      continue;
+    }
+
+    ++scanner->n_running_workers;
+  }
+  g_mutex_unlock (scanner->mutex);
+
+  scanner->delivery_interval = QUICK_DELIVERY_INTERVAL;
+  scanner->delivery_source_id = clutter_threads_add_timeout (scanner->delivery_interval,
+    on_delivery_timeout, scanner);
+
+  return scanner;
+}
+
+void
+dir_scanner_free (DirScanner *scanner)
+{
+  g_return_if_fail (scanner);
+
+  g_mutex_lock (scanner->mutex);
+  scanner->cancelled = TRUE;
+  g_cond_broadcast (scanner->cond);
+  g_mutex_unlock (scanner->mutex);
+
+  dir_scanner_join (scanner);
+
+  if (scanner->delivery_source_id)
+    g_source_remove (scanner->delivery_source_id);
+
+  guint i = 0;
+  for (i = 0; i < scanner->n_workers; ++i)
+  {
+    DirScannerWorker *worker = &scanner->workers[i];
+
+    gchar *path = NULL;
+    while ((path = (gchar*)g_queue_pop_head (&worker->directories)))
+      g_free (path);
+
+    free_batch (worker->files);
+    g_mutex_free (worker->mutex);
+  }
+
+  g_ptr_array_foreach (scanner->batches, on_foreach_free_batch, NULL);
+  g_ptr_array_free (scanner->batches, TRUE);
+
+  g_timer_destroy (scanner->timer);
+  g_cond_free (scanner->cond);
+  g_mutex_free (scanner->mutex);
+  g_free (scanner->workers);
+  g_free (scanner);
+}
+
+void
+dir_scanner_get_stats (DirScanner *scanner, guint64 *n_entries,
+  guint *n_directories, guint *n_steals, gdouble *seconds)
+{
+  g_return_if_fail (scanner);
+
+  g_mutex_lock (scanner->mutex);
+  if (n_entries)
+    *n_entries = scanner->n_entries;
+  if (n_directories)
+    *n_directories = scanner->n_directories;
+  if (seconds)
+    *seconds = g_timer_elapsed (scanner->timer, NULL);
+  g_mutex_unlock (scanner->mutex);
+
+  if (n_steals)
+    *n_steals = g_atomic_int_get (&scanner->n_steals);
+}
+
+void
+dir_scanner_get_skipped_files (DirScanner *scanner, guint n_skipped[IMAGE_SNIFF_N_RESULTS])
+{
+  g_return_if_fail (scanner);
+  g_return_if_fail (n_skipped);
+
+  g_mutex_lock (scanner->mutex);
+  memcpy (n_skipped, scanner->n_skipped_files, sizeof (scanner->n_skipped_files));
+  g_mutex_unlock (scanner->mutex);
+}
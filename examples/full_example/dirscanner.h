@@ -0,0 +1,88 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef __EXAMPLE_DIR_SCANNER_H__
+#define __EXAMPLE_DIR_SCANNER_H__
+
+#include "imagesniffer.h"
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Finds all the image files in a tree of directories, with one worker thread per
+ * processor core. Each worker has its own queue of directories to scan,
+ * to which it adds the subdirectories that it finds, and takes the newest
+ * directory from it, so that it works depth-first. A worker whose queue is
+ * empty steals the oldest directory from another worker's queue, which is
+ * likely to be the one with the most under it.
+ * The workers check each file with image_sniffer_check_file_stat(), so that
+ * only the images are handed to the main loop, as they are found.
+ */
+typedef struct _DirScanner DirScanner;
+
+/* An image file that has been found, with its st_size and st_mtime: */
+typedef struct _DirScannerFile
+{
+  gchar *path;
+  guint64 file_size;
+  gint64 file_mtime;
+}
+DirScannerFile;
+
+/* Called in the main loop (with the clutter lock held) with some of the
+ * files that have been found: the first ones as soon as they are found,
+ * and then the rest a few times a second, so that they can be added
+ * in bulk, but never too many at once. The files belong to the scanner.
+ */
+typedef void (*DirScannerFilesFunc) (const DirScannerFile *files,
+                                     guint                 n_files,
+                                     gpointer              user_data);
+
+/* Called in the main loop (with the clutter lock held) after the last files
+ * have been handed over, when the whole tree has been scanned.
+ */
+typedef void (*DirScannerDoneFunc)  (DirScanner *scanner,
+                                     gpointer    user_data);
+
+/* Start scanning the directory and all its subdirectories.
+ * Symbolic links to directories are not followed, so there can be no loops.
+ */
+DirScanner *dir_scanner_new (const gchar         *directory_path,
+                             DirScannerFilesFunc  files_func,
+                             DirScannerDoneFunc   done_func,
+                             gpointer             user_data);
+
+/* Stop scanning, if it has not finished, without calling the callbacks again. */
+void        dir_scanner_free (DirScanner *scanner);
+
+/* The number of entries (files and directories) and directories that have
+ * been scanned, the number of directories that were stolen from another
+ * worker's queue, and the time taken, in seconds, until now or until
+ * the scan finished. That includes checking the files.
+ */
+void        dir_scanner_get_stats (DirScanner *scanner,
+                                   guint64    *n_entries,
+                                   guint      *n_directories,
+                                   guint      *n_steals,
+                                   gdouble    *seconds);
+
+/* The number of files that were not images, for each ImageSniffResult: */
+void        dir_scanner_get_skipped_files (DirScanner *scanner,
+                                           guint       n_skipped[IMAGE_SNIFF_N_RESULTS]);
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_DIR_SCANNER_H__ */
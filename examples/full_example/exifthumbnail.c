@@ -0,0 +1,273 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "exifthumbnail.h"
+
+#include <string.h>
+
+/* JPEG markers: */
+#define JPEG_SOI  0xD8 /* Start of image. */
+#define JPEG_EOI  0xD9 /* End of image. */
+#define JPEG_SOS  0xDA /* Start of scan, after which the compressed data starts. */
+#define JPEG_APP1 0xE1 /* Where EXIF keeps its data. */
+
+/* The tags of IFD1, the second image file directory, which describes the thumbnail: */
+#define EXIF_TAG_THUMBNAIL_OFFSET 0x0201 /* JPEGInterchangeFormat */
+#define EXIF_TAG_THUMBNAIL_LENGTH 0x0202 /* JPEGInterchangeFormatLength */
+
+#define EXIF_IFD_ENTRY_SIZE 12
+
+/* The TIFF structure inside the APP1 segment, in its own byte order: */
+typedef struct _ExifTiff
+{
+  const guchar *data;
+  gsize length;
+  gboolean big_endian;
+}
+ExifTiff;
+
+static guint
+read_be16 (const guchar *data)
+{
+  return (data[0] << 8) | data[1];
+}
+
+static guint
+read_le16 (const guchar *data)
+{
+  return (data[1] << 8) | data[0];
+}
+
+static gboolean
+exif_tiff_read16 (const ExifTiff *tiff, gsize offset, guint *value)
+{
+  if (offset > tiff->length || tiff->length - offset < 2)
+    return FALSE;
+
+  const guchar *data = tiff->data + offset;
+  *value = tiff->big_endian ? read_be16 (data) : read_le16 (data);
+  return TRUE;
+}
+
+static gboolean
+exif_tiff_read32 (const ExifTiff *tiff, gsize offset, guint32 *value)
+{
+  if (offset > tiff->length || tiff->length - offset < 4)
+    return FALSE;
+
+  const guchar *data = tiff->data + offset;
+  if (tiff->big_endian)
+    *value = ((guint32)data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+  else
+    *value = ((guint32)data[3] << 24) | (data[2] << 16) | (data[1] << 8) | data[0];
+  return TRUE;
+}
+
+/* Call func for each of the JPEG file's segments before the compressed data,
+ * with the marker and the segment's contents, after its length,
+ * until func returns FALSE. Returns FALSE if the file ended first.
+ */
+typedef gboolean (*JpegSegmentFunc) (guint         marker,
+                                     const guchar *segment,
+                                     gsize         segment_length,
+                                     gpointer      user_data);
+
+static gboolean
+jpeg_foreach_segment (const guchar *contents, gsize length,
+  JpegSegmentFunc func, gpointer user_data)
+{
+  if (length < 2 || contents[0] != 0xFF || contents[1] != JPEG_SOI)
+    return FALSE;
+
+  gsize offset = 2;
+  while (offset + 4 <= length)
+  {
+    if (contents[offset] != 0xFF)
+      return FALSE;
+
+    /* Any number of 0xFF bytes may come before the marker: */
+    const guint marker = contents[offset + 1];
+    if (marker == 0xFF)
+    {
+      ++offset;
+      continue;
+    }
+
+    if (marker == JPEG_SOS || marker == JPEG_EOI)
+      return FALSE;
+
+    /* The length includes its own two bytes: */
+    const gsize segment_length = read_be16 (contents + offset + 2);
+    if (segment_length < 2 || offset + 2 + segment_length > length)
+      return FALSE;
+
+    if (!func (marker, contents + offset + 4, segment_length - 2, user_data))
+      return TRUE;
+
+    offset += 2 + segment_length;
+  }
+
+  return FALSE;
+}
+
+typedef struct _ExifThumbnailSearch
+{
+  const guchar *thumbnail;
+  gsize thumbnail_length;
+}
+ExifThumbnailSearch;
+
+/* Find the thumbnail's offset and length in IFD1 of the EXIF data: */
+static gboolean
+exif_tiff_find_thumbnail (const ExifTiff *tiff, ExifThumbnailSearch *search)
+{
+  guint magic = 0;
+  guint32 ifd0_offset = 0;
+  if (!exif_tiff_read16 (tiff, 2, &magic) || magic != 42 ||
+      !exif_tiff_read32 (tiff, 4, &ifd0_offset))
+    return FALSE;
+
+  /* IFD1 comes after IFD0's entries: */
+  guint n_entries = 0;
+  guint32 ifd1_offset = 0;
+  if (!exif_tiff_read16 (tiff, ifd0_offset, &n_entries) ||
+      !exif_tiff_read32 (tiff, (gsize)ifd0_offset + 2 + n_entries * EXIF_IFD_ENTRY_SIZE, &ifd1_offset) ||
+      !ifd1_offset || !exif_tiff_read16 (tiff, ifd1_offset, &n_entries))
+    return FALSE;
+
+  guint32 thumbnail_offset = 0;
+  guint32 thumbnail_length = 0;
+  guint i = 0;
+  for (i = 0; i < n_entries; ++i)
+  {
+    /* Each entry has a tag, a type, a count, and then the value itself,
+     * when it fits in 4 bytes, as a single LONG does:
+     */
+    const gsize entry = (gsize)ifd1_offset + 2 + i * EXIF_IFD_ENTRY_SIZE;
+    guint tag = 0;
+    if (!exif_tiff_read16 (tiff, entry, &tag))
+      return FALSE;
+
+    if (tag == EXIF_TAG_THUMBNAIL_OFFSET)
+      exif_tiff_read32 (tiff, entry + 8, &thumbnail_offset);
+    else if (tag == EXIF_TAG_THUMBNAIL_LENGTH)
+      exif_tiff_read32 (tiff, entry + 8, &thumbnail_length);
+  }
+
+  /* The offset is from the start of the TIFF structure: */
+  if (!thumbnail_offset || thumbnail_length < 4 ||
+      thumbnail_offset > tiff->length || tiff->length - thumbnail_offset < thumbnail_length)
+    return FALSE;
+
+  const guchar *thumbnail = tiff->data + thumbnail_offset;
+  if (thumbnail[0] != 0xFF || thumbnail[1] != JPEG_SOI)
+    return FALSE;
+
+  search->thumbnail = thumbnail;
+  search->thumbnail_length = thumbnail_length;
+  return TRUE;
+}
+
+static gboolean
+on_segment_find_thumbnail (guint marker, const guchar *segment, gsize segment_length,
+  gpointer user_data)
+{
+  /* Skip any other APP1 segments, such as XMP: */
+  static const gchar exif_header[] = "Exif\0"; /* And the implicit '\0'. */
+  if (marker != JPEG_APP1 || segment_length < sizeof (exif_header) ||
+      memcmp (segment, exif_header, sizeof (exif_header)) != 0)
+    return TRUE; /* Keep looking. */
+
+  ExifTiff tiff;
+  tiff.data = segment + sizeof (exif_header);
+  tiff.length = segment_length - sizeof (exif_header);
+  if (tiff.length < 8)
+    return FALSE;
+
+  if (memcmp (tiff.data, "MM", 2) == 0)
+    tiff.big_endian = TRUE;
+  else if (memcmp (tiff.data, "II", 2) == 0)
+    tiff.big_endian = FALSE;
+  else
+    return FALSE;
+
+  exif_tiff_find_thumbnail (&tiff, (ExifThumbnailSearch*)user_data);
+  return FALSE; /* Stop looking. */
+}
+
+gboolean
+exif_thumbnail_find (const guchar *contents, gsize length,
+  const guchar **thumbnail, gsize *thumbnail_length)
+{
+  g_return_val_if_fail (contents || !length, FALSE);
+
+  ExifThumbnailSearch search = { NULL, 0 };
+  jpeg_foreach_segment (contents, length, on_segment_find_thumbnail, &search);
+  if (!search.thumbnail)
+    return FALSE;
+
+  if (thumbnail)
+    *thumbnail = search.thumbnail;
+  if (thumbnail_length)
+    *thumbnail_length = search.thumbnail_length;
+  return TRUE;
+}
+
+typedef struct _JpegSize
+{
+  gint width;
+  gint height;
+}
+JpegSize;
+
+static gboolean
+on_segment_find_size (guint marker, const guchar *segment, gsize segment_length,
+  gpointer user_data)
+{
+  /* The frame headers are SOF0 to SOF15, except for DHT, JPG and DAC,
+   * which use three of their markers:
+   */
+  if (marker < 0xC0 || marker > 0xCF || marker == 0xC4 || marker == 0xC8 || marker == 0xCC)
+    return TRUE; /* Keep looking. */
+
+  /* The sample precision, then the height and the width: */
+  if (segment_length >= 5)
+  {
+    JpegSize *size = (JpegSize*)user_data;
+    size->height = read_be16 (segment + 1);
+    size->width = read_be16 (segment + 3);
+  }
+
+  return FALSE; /* Stop looking. */
+}
+
+gboolean
+exif_thumbnail_get_jpeg_size (const guchar *contents, gsize length,
+  gint *width, gint *height)
+{
+  g_return_val_if_fail (contents || !length, FALSE);
+
+  JpegSize size = { 0, 0 };
+  jpeg_foreach_segment (contents, length, on_segment_find_size, &size);
+  if (!size.width || !size.height)
+    return FALSE;
+
+  if (width)
+    *width = size.width;
+  if (height)
+    *height = size.height;
+  return TRUE;
+}
@@ -0,0 +1,50 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef __EXAMPLE_EXIF_THUMBNAIL_H__
+#define __EXAMPLE_EXIF_THUMBNAIL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Finds the small JPEG thumbnail that most cameras put in the EXIF data of
+ * their JPEG files, so it can be decoded instead of the whole image.
+ * This only parses the bytes that it is given, so it may be used from any
+ * thread.
+ */
+
+/* Find the thumbnail in the EXIF (APP1) segment of a JPEG file's contents.
+ * Returns FALSE if there is none. Otherwise sets thumbnail and
+ * thumbnail_length to the part of the contents that is the thumbnail,
+ * which is a JPEG file of its own.
+ */
+gboolean exif_thumbnail_find (const guchar  *contents,
+                              gsize          length,
+                              const guchar **thumbnail,
+                              gsize         *thumbnail_length);
+
+/* Get the size of the image in a JPEG file's contents from its frame header,
+ * without decoding it. Returns FALSE if the contents end before that.
+ */
+gboolean exif_thumbnail_get_jpeg_size (const guchar *contents,
+                                       gsize         length,
+                                       gint         *width,
+                                       gint         *height);
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_EXIF_THUMBNAIL_H__ */
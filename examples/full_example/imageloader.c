@@ -0,0 +1,502 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "imageloader.h"
+#include "imagepipeline.h"
+#include "exifthumbnail.h"
+
+#include <clutter/clutter.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+/* How much of a mapped file we give the decoder at a time.
+ * This is a multiple of the page size, so the pages that have been
+ * decoded can be released behind it:
+ */
+#define MAPPED_CHUNK_SIZE (1024 * 1024)
+
+/* A file that was modified this recently might still be being written,
+ * or be truncated while we decode it, which would make reading its
+ * mapped pages raise SIGBUS, so we read it instead of mapping it:
+ */
+#define RECENTLY_MODIFIED_SECONDS 5
+
+struct _ImageLoader
+{
+  GThreadPool *pool;
+
+  /* Incremented by image_loader_cancel_all(),
+   * so we can recognize jobs that were queued before that.
+   */
+  gint generation;
+
+  /* Incremented for each job, so that jobs with the same priority
+   * are decoded in the order that they were queued.
+   */
+  guint sequence;
+};
+
+typedef struct _ImageLoaderJob
+{
+  ImageLoader *loader;
+  gint generation;
+  gint priority;
+  guint sequence;
+
+  gchar *filepath;
+  gint height;
+  ImageLoaderCallback callback;
+  gpointer user_data;
+
+  /* Set by the worker thread: */
+  GdkPixbuf *pixbuf;
+}
+ImageLoaderJob;
+
+static void
+image_loader_job_free (ImageLoaderJob *job)
+{
+  if (job->pixbuf)
+    g_object_unref (job->pixbuf);
+
+  g_free (job->filepath);
+  g_slice_free (ImageLoaderJob, job);
+}
+
+static gboolean
+image_loader_job_is_cancelled (ImageLoaderJob *job)
+{
+  return job->generation != g_atomic_int_get (&job->loader->generation);
+}
+
+/* This is called in the main loop, with the clutter lock held,
+ * because we use clutter_threads_add_idle().
+ */
+static gboolean
+on_idle_deliver (gpointer data)
+{
+  ImageLoaderJob *job = (ImageLoaderJob*)data;
+
+  if (!image_loader_job_is_cancelled (job))
+    job->callback (job->filepath, job->pixbuf, job->user_data);
+
+  image_loader_job_free (job);
+
+  return FALSE; /* Don't call this again. */
+}
+
+/* Scale the pixbuf to this height, with an alpha channel and premultiplied,
+ * all in one pass:
+ */
+static GdkPixbuf*
+make_thumbnail (GdkPixbuf *pixbuf, gint height)
+{
+  const gint pixbuf_width = gdk_pixbuf_get_width (pixbuf);
+  const gint pixbuf_height = gdk_pixbuf_get_height (pixbuf);
+  const gint width = MAX (1, pixbuf_width * height / MAX (1, pixbuf_height));
+
+  GdkPixbuf *result = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, width, height);
+  if (!result)
+    return NULL;
+
+  image_pipeline_scale (gdk_pixbuf_get_pixels (pixbuf),
+    pixbuf_width, pixbuf_height, gdk_pixbuf_get_rowstride (pixbuf),
+    gdk_pixbuf_get_has_alpha (pixbuf), TRUE,
+    gdk_pixbuf_get_pixels (result), width, height, gdk_pixbuf_get_rowstride (result));
+  return result;
+}
+
+/* Decode the JPEG thumbnail that the camera put in the file's EXIF data,
+ * if it is at least this high, so we don't need to decode the whole image.
+ * Many cameras make 4:3 thumbnails even for 3:2 images, with black bars,
+ * so it must also have the same shape as the image.
+ * Returns NULL if there is no such thumbnail.
+ */
+static GdkPixbuf*
+decode_exif_thumbnail (const guchar *contents, gsize length, gint height)
+{
+  const guchar *thumbnail = NULL;
+  gsize thumbnail_length = 0;
+  gint image_width = 0, image_height = 0;
+  gint thumbnail_width = 0, thumbnail_height = 0;
+  if (!exif_thumbnail_find (contents, length, &thumbnail, &thumbnail_length) ||
+      !exif_thumbnail_get_jpeg_size (contents, length, &image_width, &image_height) ||
+      !exif_thumbnail_get_jpeg_size (thumbnail, thumbnail_length, &thumbnail_width, &thumbnail_height) ||
+      thumbnail_height < height)
+    return NULL;
+
+  /* Allow the aspect ratios to differ by 2%, for the rounding of the thumbnail's size: */
+  const gint64 difference = (gint64)thumbnail_width * image_height - (gint64)image_width * thumbnail_height;
+  if (ABS (difference) * 50 > (gint64)image_width * thumbnail_height)
+    return NULL;
+
+  /* Any errors just mean that we decode the whole image instead: */
+  GdkPixbufLoader *loader = gdk_pixbuf_loader_new ();
+  gboolean ok = gdk_pixbuf_loader_write (loader, thumbnail, thumbnail_length, NULL);
+  ok = gdk_pixbuf_loader_close (loader, NULL) && ok;
+
+  GdkPixbuf *pixbuf = NULL;
+  if (ok)
+  {
+    pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+    if (pixbuf)
+      g_object_ref (pixbuf);
+  }
+
+  g_object_unref (loader);
+  return pixbuf;
+}
+
+/* A loader for the image in contents, which lets libjpeg decode it at 1/2,
+ * 1/4 or 1/8 of its size, in the inverse DCT, choosing the smallest that is
+ * still at least as high as the thumbnail. gdk-pixbuf's JPEG loader chooses
+ * the same scale for this size, so it does not need to scale the result again.
+ */
+static GdkPixbufLoader*
+new_thumbnail_loader (const guchar *contents, gsize length, gint height,
+  ImageLoaderDecodeFlags flags)
+{
+  GdkPixbufLoader *loader = gdk_pixbuf_loader_new ();
+
+  gint image_width = 0, image_height = 0;
+  if (height > 0 && (flags & IMAGE_LOADER_SCALE_WHILE_DECODING) &&
+      exif_thumbnail_get_jpeg_size (contents, length, &image_width, &image_height))
+  {
+    gint denominator = 8;
+    while (denominator > 1 && (image_height + denominator - 1) / denominator < height)
+      denominator /= 2;
+
+    if (denominator > 1)
+      gdk_pixbuf_loader_set_size (loader, (image_width + denominator - 1) / denominator,
+        (image_height + denominator - 1) / denominator);
+  }
+
+  return loader;
+}
+
+/* Decode the file from a read-only mapping of it, so the decoder reads the
+ * file's pages directly, instead of copies of them made by read().
+ * The pages that have been decoded are released as we go, so a large file
+ * does not stay in our resident memory while the rest of it is decoded.
+ * height is the height of the thumbnail that will be made from the image,
+ * or 0 for the whole image, for which the flags are ignored.
+ * Returns NULL, without an error, if the file could not be mapped,
+ * was modified recently, or became shorter while it was decoded.
+ * If the decoder fails, failed_function is the function that failed.
+ *
+ * We don't catch SIGBUS instead, because jumping out of the decoder
+ * would leave it in an unknown state. Checking the size before each chunk
+ * leaves only a small window in which a truncation could still raise it.
+ */
+static GdkPixbuf*
+decode_mapped_file (const gchar *filepath, gint height, ImageLoaderDecodeFlags flags,
+  gboolean *used_exif_thumbnail, const gchar **failed_function, GError **error)
+{
+  const int fd = open (filepath, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  struct stat file_info;
+  guchar *contents = MAP_FAILED;
+  if (fstat (fd, &file_info) == 0 && file_info.st_size > 0 &&
+      time (NULL) - file_info.st_mtime >= RECENTLY_MODIFIED_SECONDS)
+    contents = mmap (NULL, file_info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  if (contents == MAP_FAILED)
+  {
+    close (fd);
+    return NULL;
+  }
+
+  /* We keep the file open, to check its size again before each chunk: */
+  const gsize length = file_info.st_size;
+
+  /* The EXIF data is near the start, so this touches only the first pages: */
+  if (height > 0 && (flags & IMAGE_LOADER_USE_EXIF_THUMBNAIL))
+  {
+    GdkPixbuf *thumbnail = decode_exif_thumbnail (contents, length, height);
+    if (thumbnail)
+    {
+      munmap (contents, length);
+      close (fd);
+      *used_exif_thumbnail = TRUE;
+      return thumbnail;
+    }
+  }
+
+  madvise (contents, length, MADV_SEQUENTIAL);
+
+  GdkPixbufLoader *loader = new_thumbnail_loader (contents, length, height, flags);
+
+  gboolean ok = TRUE;
+  gboolean truncated = FALSE;
+  gsize offset = 0;
+  while (ok && offset < length)
+  {
+    const gsize chunk_length = MIN (MAPPED_CHUNK_SIZE, length - offset);
+    if (fstat (fd, &file_info) != 0 || (gsize)file_info.st_size < offset + chunk_length)
+    {
+      truncated = TRUE;
+      break;
+    }
+
+    ok = gdk_pixbuf_loader_write (loader, contents + offset, chunk_length, error);
+    if (!ok)
+      *failed_function = "gdk_pixbuf_loader_write()";
+
+    madvise (contents + offset, chunk_length, MADV_DONTNEED);
+    offset += chunk_length;
+  }
+
+  /* This must be called even if the decoding failed, but then we already
+   * have an error:
+   */
+  if (!gdk_pixbuf_loader_close (loader, (ok && !truncated) ? error : NULL) && ok && !truncated)
+  {
+    *failed_function = "gdk_pixbuf_loader_close()";
+    ok = FALSE;
+  }
+
+  munmap (contents, length);
+  close (fd);
+
+  if (truncated)
+  {
+    g_object_unref (loader);
+    return NULL;
+  }
+
+  GdkPixbuf *pixbuf = NULL;
+  if (ok)
+  {
+    pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+    if (pixbuf)
+      g_object_ref (pixbuf);
+  }
+
+  g_object_unref (loader);
+  return pixbuf;
+}
+
+/* Like decode_mapped_file(), but reading the whole file into memory first,
+ * for files that we could not map or that were changing.
+ */
+static GdkPixbuf*
+decode_read_file (const gchar *filepath, gint height, ImageLoaderDecodeFlags flags,
+  gboolean *used_exif_thumbnail, const gchar **failed_function, GError **error)
+{
+  gchar *contents = NULL;
+  gsize length = 0;
+  if (!g_file_get_contents (filepath, &contents, &length, error))
+  {
+    *failed_function = "g_file_get_contents()";
+    return NULL;
+  }
+
+  if (height > 0 && (flags & IMAGE_LOADER_USE_EXIF_THUMBNAIL))
+  {
+    GdkPixbuf *thumbnail = decode_exif_thumbnail ((const guchar*)contents, length, height);
+    if (thumbnail)
+    {
+      g_free (contents);
+      *used_exif_thumbnail = TRUE;
+      return thumbnail;
+    }
+  }
+
+  GdkPixbufLoader *loader = new_thumbnail_loader ((const guchar*)contents, length, height, flags);
+
+  gboolean ok = gdk_pixbuf_loader_write (loader, (const guchar*)contents, length, error);
+  if (!ok)
+    *failed_function = "gdk_pixbuf_loader_write()";
+
+  /* This must be called even if the decoding failed, but then we already
+   * have an error:
+   */
+  if (!gdk_pixbuf_loader_close (loader, ok ? error : NULL) && ok)
+  {
+    *failed_function = "gdk_pixbuf_loader_close()";
+    ok = FALSE;
+  }
+
+  g_free (contents);
+
+  GdkPixbuf *pixbuf = NULL;
+  if (ok)
+  {
+    pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+    if (pixbuf)
+      g_object_ref (pixbuf);
+  }
+
+  g_object_unref (loader);
+  return pixbuf;
+}
+
+GdkPixbuf*
+image_loader_decode_file (const gchar *filepath, gint height, ImageLoaderDecodeFlags flags,
+  gboolean *used_exif_thumbnail)
+{
+  g_return_val_if_fail (filepath, NULL);
+
+  gboolean used_exif = FALSE;
+  const gchar *failed_function = NULL;
+  GError *error = NULL;
+  GdkPixbuf *pixbuf = decode_mapped_file (filepath, height, flags, &used_exif,
+    &failed_function, &error);
+
+  /* Read the file instead if we could not map it, or it was changing: */
+  if (!pixbuf && !error)
+    pixbuf = decode_read_file (filepath, height, flags, &used_exif,
+      &failed_function, &error);
+
+  if (error)
+  {
+    g_warning ("%s failed for %s: %s\n", failed_function, filepath, error->message);
+    g_clear_error (&error);
+  }
+
+  if (pixbuf && height > 0)
+  {
+    GdkPixbuf *thumbnail = make_thumbnail (pixbuf, height);
+    g_object_unref (pixbuf);
+    pixbuf = thumbnail;
+  }
+
+  if (used_exif_thumbnail)
+    *used_exif_thumbnail = used_exif;
+
+  return pixbuf;
+}
+
+/* This is called in one of the worker threads: */
+static void
+on_thread_pool_decode (gpointer data, gpointer user_data G_GNUC_UNUSED)
+{
+  ImageLoaderJob *job = (ImageLoaderJob*)data;
+
+  /* Don't waste time decoding something that nobody wants any more: */
+  if (image_loader_job_is_cancelled (job))
+  {
+    image_loader_job_free (job);
+    return;
+  }
+
+  job->pixbuf = image_loader_decode_file (job->filepath, job->height,
+    IMAGE_LOADER_USE_EXIF_THUMBNAIL | IMAGE_LOADER_SCALE_WHILE_DECODING, NULL);
+
+  /* It might have been cancelled while we decoded it: */
+  if (image_loader_job_is_cancelled (job))
+  {
+    image_loader_job_free (job);
+    return;
+  }
+
+  /* Let the main loop create the texture,
+   * because we may not use clutter from other threads:
+   */
+  clutter_threads_add_idle (on_idle_deliver, job);
+}
+
+static gint
+on_thread_pool_sort (gconstpointer a, gconstpointer b, gpointer user_data G_GNUC_UNUSED)
+{
+  const ImageLoaderJob *job_a = (const ImageLoaderJob*)a;
+  const ImageLoaderJob *job_b = (const ImageLoaderJob*)b;
+
+  if (job_a->priority != job_b->priority)
+    return job_a->priority < job_b->priority ? -1 : 1;
+
+  if (job_a->sequence != job_b->sequence)
+    return job_a->sequence < job_b->sequence ? -1 : 1;
+
+  return 0;
+}
+
+static gint
+get_processor_count (void)
+{
+  const long count = sysconf (_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (gint)count : 1;
+}
+
+ImageLoader*
+image_loader_new (void)
+{
+  ImageLoader *loader = g_new0 (ImageLoader, 1);
+
+  GError *error = NULL;
+  loader->pool = g_thread_pool_new (on_thread_pool_decode, loader,
+    get_processor_count (), TRUE /* exclusive */, &error);
+  if (error)
+  {
+    g_warning ("g_thread_pool_new() failed: %s\n", error->message);
+    g_clear_error (&error);
+    g_free (loader);
+    return NULL;
+  }
+
+  g_thread_pool_set_sort_function (loader->pool, on_thread_pool_sort, NULL);
+
+  return loader;
+}
+
+void
+image_loader_free (ImageLoader *loader)
+{
+  g_return_if_fail (loader);
+
+  image_loader_cancel_all (loader);
+
+  /* Let the worker threads take the jobs that are still waiting, which are
+   * cancelled now, so they just free them, and wait for them to finish.
+   */
+  g_thread_pool_free (loader->pool, FALSE /* immediate */, TRUE /* wait */);
+  g_free (loader);
+}
+
+void
+image_loader_queue (ImageLoader *loader, const gchar *filepath, gint height, gint priority,
+  ImageLoaderCallback callback, gpointer user_data)
+{
+  g_return_if_fail (loader);
+  g_return_if_fail (filepath);
+  g_return_if_fail (callback);
+
+  ImageLoaderJob *job = g_slice_new0 (ImageLoaderJob);
+  job->loader = loader;
+  job->generation = g_atomic_int_get (&loader->generation);
+  job->priority = priority;
+  job->sequence = loader->sequence++;
+  job->filepath = g_strdup (filepath);
+  job->height = height;
+  job->callback = callback;
+  job->user_data = user_data;
+
+  g_thread_pool_push (loader->pool, job, NULL);
+}
+
+void
+image_loader_cancel_all (ImageLoader *loader)
+{
+  g_return_if_fail (loader);
+
+  g_atomic_int_inc (&loader->generation);
+}
@@ -0,0 +1,89 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef __EXAMPLE_IMAGE_LOADER_H__
+#define __EXAMPLE_IMAGE_LOADER_H__
+
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+/* Decodes image files in a pool of worker threads, one per processor core,
+ * and hands the decoded pixels back to the main loop.
+ * The files are memory-mapped and given to the decoder directly, or read
+ * into memory if they might still be changing.
+ * For thumbnails, the small JPEG thumbnail that cameras put in their files'
+ * EXIF data is decoded instead of the whole image, if it is big enough.
+ * Otherwise JPEG images are decoded at the smallest of 1/2, 1/4 or 1/8 of
+ * their size that is still big enough.
+ */
+typedef struct _ImageLoader ImageLoader;
+
+/* Called in the main loop (with the clutter lock held) when a file has been
+ * decoded. pixbuf is NULL if the file could not be decoded.
+ * The callback does not own the pixbuf, so it must ref it to keep it.
+ */
+typedef void (*ImageLoaderCallback) (const gchar *filepath,
+                                     GdkPixbuf   *pixbuf,
+                                     gpointer     user_data);
+
+ImageLoader *image_loader_new (void);
+void         image_loader_free (ImageLoader *loader);
+
+/* Queue a file for decoding. If height is more than 0 then the image is
+ * scaled to that height, keeping its aspect ratio, given an alpha channel,
+ * and premultiplied, so it is ready to be used as an RGBA thumbnail.
+ * Otherwise it is left at its full size, and is not premultiplied.
+ * Files with a lower priority value are decoded first. Files with the same
+ * priority are decoded in the order they were queued.
+ */
+void         image_loader_queue (ImageLoader         *loader,
+                                 const gchar         *filepath,
+                                 gint                 height,
+                                 gint                 priority,
+                                 ImageLoaderCallback  callback,
+                                 gpointer             user_data);
+
+/* The shortcuts that image_loader_decode_file() may take for thumbnails: */
+typedef enum
+{
+  /* Decode the EXIF thumbnail instead of the image, if it is big enough: */
+  IMAGE_LOADER_USE_EXIF_THUMBNAIL = 1 << 0,
+
+  /* Let libjpeg decode a JPEG image at 1/2, 1/4 or 1/8 of its size: */
+  IMAGE_LOADER_SCALE_WHILE_DECODING = 1 << 1
+}
+ImageLoaderDecodeFlags;
+
+/* Decode a file now, in this thread, as the worker threads do, which use all
+ * the flags. This lets them be compared.
+ * used_exif_thumbnail, if not NULL, says whether that was used.
+ * Returns NULL if the file could not be decoded.
+ */
+GdkPixbuf   *image_loader_decode_file (const gchar            *filepath,
+                                       gint                    height,
+                                       ImageLoaderDecodeFlags  flags,
+                                       gboolean               *used_exif_thumbnail);
+
+/* Forget about all queued files. The callbacks for them will never be called,
+ * even if they are being decoded right now.
+ */
+void         image_loader_cancel_all (ImageLoader *loader);
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_IMAGE_LOADER_H__ */
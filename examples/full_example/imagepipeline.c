@@ -0,0 +1,368 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "imagepipeline.h"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Each source pixel adds at most 255 * 255 to a column sum, so this many rows
+ * can be summed before a sum would overflow the signed 32-bit integers
+ * that SSE2 converts to floats:
+ */
+#define MAX_SUMMED_ROWS (G_MAXINT32 / (255 * 255))
+
+/* The source pixels [start, end) that destination pixel index covers: */
+static void
+get_span (gint src_size, gint dest_size, gint index, gint *start, gint *end)
+{
+  *start = (gint64)index * src_size / dest_size;
+  *end = MAX (*start + 1, (gint64)(index + 1) * src_size / dest_size);
+}
+
+/* Add a source row to the column sums. Each channel is multiplied by the
+ * pixel's alpha if it must be premultiplied, or by 255 otherwise, and the
+ * alpha itself by 255, so that the sums are all in the same units:
+ */
+static void
+accumulate_row_scalar (guint32 *sums, const guchar *row, gint width,
+  gboolean has_alpha, gboolean premultiply)
+{
+  gint x = 0;
+  if (!has_alpha)
+  {
+    for (x = 0; x < width; ++x, row += 3, sums += 4)
+    {
+      sums[0] += row[0] * 255;
+      sums[1] += row[1] * 255;
+      sums[2] += row[2] * 255;
+      sums[3] += 255 * 255;
+    }
+
+    return;
+  }
+
+  for (x = 0; x < width; ++x, row += 4, sums += 4)
+  {
+    const guint32 alpha = row[3];
+    const guint32 factor = premultiply ? alpha : 255;
+    sums[0] += row[0] * factor;
+    sums[1] += row[1] * factor;
+    sums[2] += row[2] * factor;
+    sums[3] += alpha * 255;
+  }
+}
+
+/* Add the column sums to the column totals, as floats, and clear them,
+ * so that they can't overflow however many rows a destination row covers:
+ */
+static void
+add_sums_scalar (gfloat *totals, guint32 *sums, gint n_sums)
+{
+  gint i = 0;
+  for (i = 0; i < n_sums; ++i)
+  {
+    totals[i] += (gfloat)(gint32)sums[i];
+    sums[i] = 0;
+  }
+}
+
+/* Average the column totals over each destination pixel's columns.
+ * The scales are 1 / (255 * the number of source pixels) for each pixel.
+ */
+static void
+write_row_scalar (guchar *dest, const gfloat *totals, gint dest_width,
+  const gint *x_starts, const gint *x_ends, const gfloat *x_scales, gfloat row_scale)
+{
+  gint x = 0;
+  for (x = 0; x < dest_width; ++x, dest += 4)
+  {
+    gfloat total[4] = { 0, 0, 0, 0 };
+    gint sx = 0;
+    for (sx = x_starts[x]; sx < x_ends[x]; ++sx)
+    {
+      total[0] += totals[sx * 4];
+      total[1] += totals[sx * 4 + 1];
+      total[2] += totals[sx * 4 + 2];
+      total[3] += totals[sx * 4 + 3];
+    }
+
+    const gfloat scale = x_scales[x] * row_scale;
+    gint c = 0;
+    for (c = 0; c < 4; ++c)
+      dest[c] = (gint)(total[c] * scale + 0.5f);
+  }
+}
+
+#ifdef __SSE2__
+
+/* Add two pixels, with 16 bits for each channel, to the column sums,
+ * and the next two pixels to the next column sums:
+ */
+static inline void
+add_pixels_sse2 (guint32 *sums, __m128i low, __m128i high)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+
+  /* The products fit in 16 bits, as long as we treat them as unsigned: */
+  __m128i *column_sums = (__m128i*)sums;
+  _mm_storeu_si128 (column_sums, _mm_add_epi32 (_mm_loadu_si128 (column_sums),
+    _mm_unpacklo_epi16 (low, zero)));
+  _mm_storeu_si128 (column_sums + 1, _mm_add_epi32 (_mm_loadu_si128 (column_sums + 1),
+    _mm_unpackhi_epi16 (low, zero)));
+  _mm_storeu_si128 (column_sums + 2, _mm_add_epi32 (_mm_loadu_si128 (column_sums + 2),
+    _mm_unpacklo_epi16 (high, zero)));
+  _mm_storeu_si128 (column_sums + 3, _mm_add_epi32 (_mm_loadu_si128 (column_sums + 3),
+    _mm_unpackhi_epi16 (high, zero)));
+}
+
+/* Spread the first two RGB pixels out to RGBA, with 16 bits for each channel
+ * and an alpha of 255:
+ */
+static inline __m128i
+expand_rgb_sse2 (__m128i pixels, __m128i alpha_mask, __m128i opaque_alpha)
+{
+  /* R0 G0 B0 R1 G1 B1 R2 G2, and then R0 G0 B0 R1 R1 G1 B1 R2: */
+  __m128i words = _mm_unpacklo_epi8 (pixels, _mm_setzero_si128 ());
+  words = _mm_unpacklo_epi64 (words, _mm_srli_si128 (words, 6));
+
+  return _mm_or_si128 (_mm_andnot_si128 (alpha_mask, words), opaque_alpha);
+}
+
+/* Like accumulate_row_scalar() for RGB rows, 4 pixels at a time: */
+static void
+accumulate_rgb_row_sse2 (guint32 *sums, const guchar *row, gint width)
+{
+  const __m128i opaque = _mm_set1_epi16 (255);
+  const __m128i alpha_mask = _mm_set_epi16 (-1, 0, 0, 0, -1, 0, 0, 0);
+  const __m128i opaque_alpha = _mm_and_si128 (alpha_mask, opaque);
+
+  /* Each load reads 16 bytes, of which the 4 pixels use only 12: */
+  gint x = 0;
+  for (x = 0; x * 3 + 16 <= width * 3; x += 4)
+  {
+    const __m128i pixels = _mm_loadu_si128 ((const __m128i*)(row + x * 3));
+    const __m128i low = expand_rgb_sse2 (pixels, alpha_mask, opaque_alpha);
+    const __m128i high = expand_rgb_sse2 (_mm_srli_si128 (pixels, 6), alpha_mask, opaque_alpha);
+
+    add_pixels_sse2 (sums + x * 4, _mm_mullo_epi16 (low, opaque),
+      _mm_mullo_epi16 (high, opaque));
+  }
+
+  accumulate_row_scalar (sums + x * 4, row + x * 3, width - x, FALSE, FALSE);
+}
+
+/* Like accumulate_row_scalar() for RGBA rows, 4 pixels at a time: */
+static void
+accumulate_rgba_row_sse2 (guint32 *sums, const guchar *row, gint width, gboolean premultiply)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i opaque = _mm_set1_epi16 (255);
+  const __m128i alpha_mask = _mm_set_epi16 (-1, 0, 0, 0, -1, 0, 0, 0);
+
+  gint x = 0;
+  for (x = 0; x + 4 <= width; x += 4)
+  {
+    const __m128i pixels = _mm_loadu_si128 ((const __m128i*)(row + x * 4));
+
+    /* Two pixels in each, with 16 bits for each channel: */
+    __m128i low = _mm_unpacklo_epi8 (pixels, zero);
+    __m128i high = _mm_unpackhi_epi8 (pixels, zero);
+
+    if (premultiply)
+    {
+      /* Copy each pixel's alpha to all of its channels,
+       * except for the alpha itself, which is multiplied by 255:
+       */
+      __m128i low_factors = _mm_shufflehi_epi16 (
+        _mm_shufflelo_epi16 (low, _MM_SHUFFLE (3, 3, 3, 3)), _MM_SHUFFLE (3, 3, 3, 3));
+      __m128i high_factors = _mm_shufflehi_epi16 (
+        _mm_shufflelo_epi16 (high, _MM_SHUFFLE (3, 3, 3, 3)), _MM_SHUFFLE (3, 3, 3, 3));
+      low_factors = _mm_or_si128 (_mm_andnot_si128 (alpha_mask, low_factors),
+        _mm_and_si128 (alpha_mask, opaque));
+      high_factors = _mm_or_si128 (_mm_andnot_si128 (alpha_mask, high_factors),
+        _mm_and_si128 (alpha_mask, opaque));
+
+      low = _mm_mullo_epi16 (low, low_factors);
+      high = _mm_mullo_epi16 (high, high_factors);
+    }
+    else
+    {
+      low = _mm_mullo_epi16 (low, opaque);
+      high = _mm_mullo_epi16 (high, opaque);
+    }
+
+    add_pixels_sse2 (sums + x * 4, low, high);
+  }
+
+  accumulate_row_scalar (sums + x * 4, row + x * 4, width - x, TRUE, premultiply);
+}
+
+/* Like add_sums_scalar(), 4 sums at a time. There are 4 for each pixel: */
+static void
+add_sums_sse2 (gfloat *totals, guint32 *sums, gint n_sums)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+
+  gint i = 0;
+  for (i = 0; i < n_sums; i += 4)
+  {
+    __m128i *column_sums = (__m128i*)(sums + i);
+    _mm_storeu_ps (totals + i, _mm_add_ps (_mm_loadu_ps (totals + i),
+      _mm_cvtepi32_ps (_mm_loadu_si128 (column_sums))));
+    _mm_storeu_si128 (column_sums, zero);
+  }
+}
+
+/* Like write_row_scalar(), with all 4 channels of a pixel at once,
+ * and with the same rounding, so the results are the same:
+ */
+static void
+write_row_sse2 (guchar *dest, const gfloat *totals, gint dest_width,
+  const gint *x_starts, const gint *x_ends, const gfloat *x_scales, gfloat row_scale)
+{
+  const __m128 half = _mm_set1_ps (0.5f);
+
+  gint x = 0;
+  for (x = 0; x < dest_width; ++x, dest += 4)
+  {
+    __m128 total = _mm_setzero_ps ();
+    gint sx = 0;
+    for (sx = x_starts[x]; sx < x_ends[x]; ++sx)
+      total = _mm_add_ps (total, _mm_loadu_ps (totals + sx * 4));
+
+    const __m128 scale = _mm_set1_ps (x_scales[x] * row_scale);
+    __m128i result = _mm_cvttps_epi32 (
+      _mm_add_ps (_mm_mul_ps (total, scale), half));
+    result = _mm_packs_epi32 (result, result);
+    result = _mm_packus_epi16 (result, result);
+
+    const gint32 pixel = _mm_cvtsi128_si32 (result);
+    memcpy (dest, &pixel, 4);
+  }
+}
+
+#endif /* __SSE2__ */
+
+static void
+image_pipeline_scale_internal (const guchar *src,
+  gint src_width, gint src_height, gint src_rowstride,
+  gboolean src_has_alpha, gboolean premultiply,
+  guchar *dest, gint dest_width, gint dest_height, gint dest_rowstride,
+  gboolean use_sse2)
+{
+  g_return_if_fail (src && dest);
+  g_return_if_fail (src_width > 0 && src_height > 0);
+  g_return_if_fail (dest_width > 0 && dest_height > 0);
+
+  /* Each destination column covers the same source columns in every row: */
+  gint *x_starts = g_new (gint, dest_width);
+  gint *x_ends = g_new (gint, dest_width);
+  gfloat *x_scales = g_new (gfloat, dest_width);
+  gint x = 0;
+  for (x = 0; x < dest_width; ++x)
+  {
+    get_span (src_width, dest_width, x, x_starts + x, x_ends + x);
+    x_scales[x] = 1.0f / (255 * (x_ends[x] - x_starts[x]));
+  }
+
+  /* The sums of up to MAX_SUMMED_ROWS rows for each column,
+   * and the totals of those sums for the current destination row:
+   */
+  const gint n_sums = src_width * 4;
+  guint32 *sums = g_new0 (guint32, n_sums);
+  gfloat *totals = g_new (gfloat, n_sums);
+
+  gint y = 0;
+  for (y = 0; y < dest_height; ++y)
+  {
+    gint y_start = 0;
+    gint y_end = 0;
+    get_span (src_height, dest_height, y, &y_start, &y_end);
+
+    memset (totals, 0, n_sums * sizeof (gfloat));
+
+    gint sy = 0;
+    for (sy = y_start; sy < y_end; ++sy)
+    {
+      const guchar *row = src + sy * src_rowstride;
+#ifdef __SSE2__
+      if (use_sse2)
+      {
+        if (src_has_alpha)
+          accumulate_rgba_row_sse2 (sums, row, src_width, premultiply);
+        else
+          accumulate_rgb_row_sse2 (sums, row, src_width);
+      }
+      else
+#endif
+        accumulate_row_scalar (sums, row, src_width, src_has_alpha, premultiply);
+
+      /* Move the sums to the totals when they are full, and at the end: */
+      if ((sy - y_start + 1) % MAX_SUMMED_ROWS && sy + 1 < y_end)
+        continue;
+
+#ifdef __SSE2__
+      if (use_sse2)
+      {
+        add_sums_sse2 (totals, sums, n_sums);
+        continue;
+      }
+#endif
+      add_sums_scalar (totals, sums, n_sums);
+    }
+
+    const gfloat row_scale = 1.0f / (y_end - y_start);
+    guchar *dest_row = dest + y * dest_rowstride;
+#ifdef __SSE2__
+    if (use_sse2)
+    {
+      write_row_sse2 (dest_row, totals, dest_width, x_starts, x_ends, x_scales, row_scale);
+      continue;
+    }
+#endif
+    write_row_scalar (dest_row, totals, dest_width, x_starts, x_ends, x_scales, row_scale);
+  }
+
+  g_free (totals);
+  g_free (sums);
+  g_free (x_scales);
+  g_free (x_ends);
+  g_free (x_starts);
+}
+
+void
+image_pipeline_scale (const guchar *src,
+  gint src_width, gint src_height, gint src_rowstride,
+  gboolean src_has_alpha, gboolean premultiply,
+  guchar *dest, gint dest_width, gint dest_height, gint dest_rowstride)
+{
+  image_pipeline_scale_internal (src, src_width, src_height, src_rowstride,
+    src_has_alpha, premultiply, dest, dest_width, dest_height, dest_rowstride, TRUE);
+}
+
+void
+image_pipeline_scale_scalar (const guchar *src,
+  gint src_width, gint src_height, gint src_rowstride,
+  gboolean src_has_alpha, gboolean premultiply,
+  guchar *dest, gint dest_width, gint dest_height, gint dest_rowstride)
+{
+  image_pipeline_scale_internal (src, src_width, src_height, src_rowstride,
+    src_has_alpha, premultiply, dest, dest_width, dest_height, dest_rowstride, FALSE);
+}
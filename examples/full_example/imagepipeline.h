@@ -0,0 +1,62 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef __EXAMPLE_IMAGE_PIPELINE_H__
+#define __EXAMPLE_IMAGE_PIPELINE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Scale RGB or RGBA pixels to premultiplied RGBA pixels of another size,
+ * in one pass over each row of the source: each pixel is expanded to RGBA,
+ * premultiplied by its alpha, and added to a sum for its column, and then
+ * each destination pixel is the average of the source pixels that it covers
+ * (a box filter). That is what a thumbnail needs, and it avoids the separate
+ * scaling, gdk_pixbuf_add_alpha() and premultiplying (by Cogl, on upload)
+ * that we did before.
+ * When scaling up, each destination pixel is just the nearest source pixel.
+ * If premultiply is FALSE then the source is premultiplied already.
+ * Rows are done 4 pixels at a time with SSE2, where that is available.
+ */
+void image_pipeline_scale (const guchar *src,
+                           gint          src_width,
+                           gint          src_height,
+                           gint          src_rowstride,
+                           gboolean      src_has_alpha,
+                           gboolean      premultiply,
+                           guchar       *dest,
+                           gint          dest_width,
+                           gint          dest_height,
+                           gint          dest_rowstride);
+
+/* Like image_pipeline_scale(), but without SSE2, for comparison.
+ * The results are the same.
+ */
+void image_pipeline_scale_scalar (const guchar *src,
+                                  gint          src_width,
+                                  gint          src_height,
+                                  gint          src_rowstride,
+                                  gboolean      src_has_alpha,
+                                  gboolean      premultiply,
+                                  guchar       *dest,
+                                  gint          dest_width,
+                                  gint          dest_height,
+                                  gint          dest_rowstride);
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_IMAGE_PIPELINE_H__ */
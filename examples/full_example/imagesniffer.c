@@ -0,0 +1,233 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "imagesniffer.h"
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib/gstdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+/* The longest and shortest signatures that we check: */
+#define SNIFF_LENGTH 12
+#define MIN_SIGNATURE_LENGTH 2
+
+typedef struct _ImageSignature
+{
+  const gchar *format_name; /* As used by gdk-pixbuf. */
+  gsize offset;
+  const gchar *bytes;
+  gsize length;
+}
+ImageSignature;
+
+static const ImageSignature signatures[] =
+{
+  { "jpeg", 0, "\xFF\xD8\xFF", 3 },
+  { "png",  0, "\x89PNG\r\n\x1A\n", 8 },
+  { "gif",  0, "GIF87a", 6 },
+  { "gif",  0, "GIF89a", 6 },
+  { "bmp",  0, "BM", 2 },
+  { "tiff", 0, "II*\0", 4 },
+  { "tiff", 0, "MM\0*", 4 },
+  { "ico",  0, "\0\0\1\0", 4 },
+  { "ani",  8, "ACON", 4 }, /* After "RIFF" and the length. */
+  { "xpm",  0, "/* XPM */", 9 },
+  { "pnm",  0, "P1", 2 },
+  { "pnm",  0, "P2", 2 },
+  { "pnm",  0, "P3", 2 },
+  { "pnm",  0, "P4", 2 },
+  { "pnm",  0, "P5", 2 },
+  { "pnm",  0, "P6", 2 },
+  { "pnm",  0, "P7", 2 }, /* PAM */
+  { "webp", 8, "WEBP", 4 }, /* After "RIFF" and the length. */
+  { "icns", 0, "icns", 4 },
+  { "xbm",  0, "#define ", 8 },
+};
+
+/* The formats that gdk-pixbuf has loaders for.
+ * This is created once, by whichever thread needs it first:
+ */
+typedef struct _LoadableFormats
+{
+  /* The format names, such as "jpeg", as keys and values: */
+  GHashTable *names;
+
+  /* The formats' filename extensions, such as "tga", with their names as values: */
+  GHashTable *extensions;
+}
+LoadableFormats;
+
+static GOnce loadable_formats_once = G_ONCE_INIT;
+
+static gpointer
+create_loadable_formats (gpointer data G_GNUC_UNUSED)
+{
+  LoadableFormats *loadable_formats = g_new0 (LoadableFormats, 1);
+  loadable_formats->names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  loadable_formats->extensions = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  GSList *formats = gdk_pixbuf_get_formats ();
+  GSList *iter = NULL;
+  for (iter = formats; iter; iter = iter->next)
+  {
+    GdkPixbufFormat *format = (GdkPixbufFormat*)iter->data;
+    if (gdk_pixbuf_format_is_disabled (format))
+      continue;
+
+    /* gdk_pixbuf_format_get_name() returns a newly-allocated string: */
+    gchar *name = gdk_pixbuf_format_get_name (format);
+    g_hash_table_insert (loadable_formats->names, name, name);
+
+    gchar **extensions = gdk_pixbuf_format_get_extensions (format);
+    gchar **extension = NULL;
+    for (extension = extensions; extension && *extension; ++extension)
+      g_hash_table_insert (loadable_formats->extensions, g_ascii_strdown (*extension, -1), name);
+    g_strfreev (extensions);
+  }
+
+  g_slist_free (formats);
+  return loadable_formats;
+}
+
+static LoadableFormats*
+get_loadable_formats (void)
+{
+  return (LoadableFormats*)g_once (&loadable_formats_once, create_loadable_formats, NULL);
+}
+
+static gboolean
+is_format_loadable (const gchar *format_name)
+{
+  return g_hash_table_lookup (get_loadable_formats ()->names, format_name) != NULL;
+}
+
+/* Some formats, such as TGA, have no signature. For a file whose extension
+ * is one of a loader's, ask gdk-pixbuf's loaders whether they recognize it.
+ * Returns the name of the format, or NULL.
+ */
+static const gchar*
+check_file_by_extension (const gchar *filepath)
+{
+  const gchar *dot = strrchr (filepath, '.');
+  if (!dot || strchr (dot, G_DIR_SEPARATOR))
+    return NULL;
+
+  gchar *extension = g_ascii_strdown (dot + 1, -1);
+  const gchar *name = (const gchar*)g_hash_table_lookup (get_loadable_formats ()->extensions, extension);
+  g_free (extension);
+
+  if (!name || !gdk_pixbuf_get_file_info (filepath, NULL, NULL))
+    return NULL;
+
+  return name;
+}
+
+ImageSniffResult
+image_sniffer_check_file (const gchar *filepath, const gchar **format_name)
+{
+  return image_sniffer_check_file_stat (filepath, format_name, NULL, NULL);
+}
+
+ImageSniffResult
+image_sniffer_check_file_stat (const gchar *filepath, const gchar **format_name,
+  guint64 *file_size, gint64 *file_mtime)
+{
+  g_return_val_if_fail (filepath, IMAGE_SNIFF_UNREADABLE);
+
+  if (format_name)
+    *format_name = NULL;
+
+  /* Opening a FIFO would block until something writes to it, unless we
+   * don't wait. That makes no difference for regular files:
+   */
+  const int fd = g_open (filepath, O_RDONLY | O_NONBLOCK, 0);
+  if (fd < 0)
+    return IMAGE_SNIFF_UNREADABLE;
+
+  /* Check the file that we opened, rather than stat()ing the path too: */
+  struct stat buf;
+  if (fstat (fd, &buf) != 0 || !S_ISREG (buf.st_mode))
+  {
+    close (fd);
+    return IMAGE_SNIFF_NOT_REGULAR;
+  }
+
+  if (file_size)
+    *file_size = buf.st_size;
+  if (file_mtime)
+    *file_mtime = buf.st_mtime;
+
+  guchar header[SNIFF_LENGTH];
+  const ssize_t length = read (fd, header, sizeof (header));
+  close (fd);
+
+  if (length < 0)
+    return IMAGE_SNIFF_UNREADABLE;
+
+  if (length < MIN_SIGNATURE_LENGTH)
+    return IMAGE_SNIFF_TOO_SHORT;
+
+  guint i = 0;
+  for (i = 0; i < G_N_ELEMENTS (signatures); ++i)
+  {
+    const ImageSignature *signature = &signatures[i];
+    if (signature->offset + signature->length > (gsize)length)
+      continue;
+
+    if (memcmp (header + signature->offset, signature->bytes, signature->length) != 0)
+      continue;
+
+    if (format_name)
+      *format_name = signature->format_name;
+
+    return is_format_loadable (signature->format_name) ? IMAGE_SNIFF_OK : IMAGE_SNIFF_NO_LOADER;
+  }
+
+  const gchar *name = check_file_by_extension (filepath);
+  if (!name)
+    return IMAGE_SNIFF_UNKNOWN;
+
+  if (format_name)
+    *format_name = name;
+
+  return IMAGE_SNIFF_OK;
+}
+
+const gchar*
+image_sniffer_result_to_string (ImageSniffResult result)
+{
+  switch (result)
+  {
+    case IMAGE_SNIFF_OK:
+      return "an image";
+    case IMAGE_SNIFF_NOT_REGULAR:
+      return "not a regular file";
+    case IMAGE_SNIFF_UNREADABLE:
+      return "unreadable";
+    case IMAGE_SNIFF_TOO_SHORT:
+      return "too short to be an image";
+    case IMAGE_SNIFF_UNKNOWN:
+      return "not an image";
+    case IMAGE_SNIFF_NO_LOADER:
+      return "no loader for the format";
+    default:
+      return "unknown";
+  }
+}
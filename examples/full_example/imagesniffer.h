@@ -0,0 +1,64 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef __EXAMPLE_IMAGE_SNIFFER_H__
+#define __EXAMPLE_IMAGE_SNIFFER_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Recognizes image files from the first few bytes of their contents,
+ * so that other files can be skipped without asking gdk-pixbuf's loaders,
+ * which might each read and parse them. The loaders are only asked about
+ * files of formats that have no signature, such as TGA, and only if the file
+ * has one of the loaders' extensions.
+ */
+typedef enum
+{
+  IMAGE_SNIFF_OK,
+  IMAGE_SNIFF_NOT_REGULAR,   /* A directory, device, etc. */
+  IMAGE_SNIFF_UNREADABLE,
+  IMAGE_SNIFF_TOO_SHORT,
+  IMAGE_SNIFF_UNKNOWN,       /* Not a signature of any image format that we know,
+                              * nor recognized by a loader for its extension. */
+  IMAGE_SNIFF_NO_LOADER,     /* An image format that gdk-pixbuf can't load here. */
+  IMAGE_SNIFF_N_RESULTS
+}
+ImageSniffResult;
+
+/* Read just the start of the file to check whether it is an image that
+ * gdk-pixbuf can load. format_name, if not NULL, is set to the gdk-pixbuf
+ * name of the format, such as "jpeg", if the file has a known signature.
+ * This may be called from any thread.
+ */
+ImageSniffResult image_sniffer_check_file (const gchar  *filepath,
+                                           const gchar **format_name);
+
+/* Like image_sniffer_check_file(), also giving the size and modification
+ * time of a regular file, so that it doesn't need to be stat()ed again.
+ */
+ImageSniffResult image_sniffer_check_file_stat (const gchar  *filepath,
+                                                const gchar **format_name,
+                                                guint64      *file_size,
+                                                gint64       *file_mtime);
+
+/* A short description of why a file was skipped, such as "not an image". */
+const gchar     *image_sniffer_result_to_string (ImageSniffResult result);
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_IMAGE_SNIFFER_H__ */
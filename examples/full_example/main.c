@@ -14,363 +14,2808 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
  */
 
+#include "arena.h"
+#include "atlasimage.h"
+#include "benchmark.h"
+#include "carouselgroup.h"
+#include "carousellayout.h"
+#include "dirscanner.h"
+#include "imageloader.h"
+#include "imagepipeline.h"
+#include "imagesniffer.h"
+#include "perfhud.h"
+#include "textureatlas.h"
+#include "thumbnailcache.h"
 #include <clutter/clutter.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 ClutterActor *stage = NULL;
 
 /* For showing the filename: */
 ClutterActor *label_filename = NULL;
 
-/* For rotating all images around an ellipse: */
+/* For rotating all images around an ellipse.
+ * The timeline just provides the frames, looping until the rotation has finished:
+ */
 ClutterTimeline *timeline_rotation = NULL;
 
-/* For moving one image up and scaling it: */
-ClutterTimeline *timeline_moveup = NULL;
-ClutterBehaviour *behaviour_scale = NULL;
-ClutterBehaviour *behaviour_path = NULL;
-ClutterBehaviour *behaviour_opacity = NULL;
+/* Positions all the actors on the ellipse in one pass per frame.
+ * carousel_actors has one actor for each position in the layout.
+ */
+CarouselLayout *carousel_layout = NULL;
+ClutterActor **carousel_actors = NULL;
+guint n_carousel_actors_allocated = 0;
+
+/* Paints the items, and the plane under them, from the back to the front: */
+ClutterActor *carousel_group = NULL;
+
+/* The current rotation moves a value (how far all the items have rotated,
+ * in degrees, or virtual_front in the virtual mode) from motion_from to
+ * motion_to, along a curve that starts at motion_velocity and ends at rest.
+ * A new target continues from the current value and speed, so a click can
+ * change the rotation without the items jumping or stopping.
+ */
+gdouble motion_from = 0;
+gdouble motion_to = 0;
+gdouble motion_velocity = 0; /* per second */
+gdouble motion_duration = 0; /* seconds */
+GTimer *motion_timer = NULL;
+
+/* The angle of the first item when the current rotation started: */
+gdouble rotation_start_angle = 0;
+
+/* For decoding the images without blocking the main loop: */
+ImageLoader *image_loader = NULL;
+gint pending_image_loads = 0;
+
+/* The full-size image of the item that is rotating to the front, by filepath.
+ * The value is NULL while it is being decoded.
+ * Only that item is decoded at full size, because that is the slow decode
+ * that the EXIF thumbnails avoid for the others:
+ */
+GHashTable *full_images = NULL;
+
+/* For showing the images again without decoding them again: */
+ThumbnailCache *thumbnail_cache = NULL;
+
+/* Saving the cache rewrites the whole file, so we wait until no new thumbnails
+ * have been made for a while, rather than saving after each batch of them:
+ */
+guint save_thumbnail_cache_source = 0;
+const guint SAVE_THUMBNAIL_CACHE_DELAY = 5000; /* milliseconds */
+
+/* For drawing many thumbnails with few textures: */
+TextureAtlas *texture_atlas = NULL;
+const gint ATLAS_PAGE_SIZE = 1024;
+
+/* For moving one image up and scaling it.
+ * These are created once, and given new start and end values for each item:
+ */
+ClutterTimeline *timeline_moveup = NULL;
+ClutterAlpha *alpha_moveup = NULL;
+ClutterBehaviour *behaviour_scale = NULL;
+ClutterBehaviour *behaviour_path = NULL;
+ClutterBehaviour *behaviour_opacity = NULL;
+
+/* The y position of the ellipse of images: */
+const gint ELLIPSE_Y = 390;
+const gint ELLIPSE_HEIGHT = 450; /* The distance from front to back when it's rotated 90 degrees. */
+const gint IMAGE_HEIGHT = 100;
+
+static gboolean
+on_texture_button_press (ClutterActor *actor, ClutterEvent *event, gpointer data);
+
+const double angle_step = 30;
+
+/* The resolutions that an item's texture can have.
+ * The smaller tiers are made from the thumbnail, for items at the back of
+ * the ellipse, which look smaller. The full tier is decoded from the file,
+ * but only for the item that is moved up at the front.
+ */
+typedef enum
+{
+  ITEM_TIER_NONE,
+  ITEM_TIER_QUARTER,
+  ITEM_TIER_HALF,
+  ITEM_TIER_THUMBNAIL,
+  ITEM_TIER_FULL
+}
+ItemTier;
+
+/* A file's path, split into its directory, with the separator at the end,
+ * and its name, so that the items in one directory can share the directory.
+ * For looking up a whole path, the directory is the whole path and the
+ * name is NULL.
+ */
+typedef struct ItemPath
+{
+  const gchar *directory;
+  gchar *name;
+}
+ItemPath;
+
+typedef struct Item
+{
+  ClutterActor *actor;
+  ItemPath path; /* In item_arena. */
+  gboolean has_thumbnail;
+  ItemTier tier;
+
+  /* The item's position in the items array: */
+  guint index;
+
+  /* Whether the thumbnail is being decoded: */
+  gboolean thumbnail_requested;
+
+  /* For keeping the textures within the budget.
+   * texture_bytes is 0 when the texture is a region of an atlas page,
+   * because the atlas pages are counted as a whole:
+   */
+  gboolean has_texture;
+  gsize texture_bytes;
+  GList lru_link; /* In lru_items while the item has a texture. */
+  guint visible_frame;
+  gboolean evicted;
+
+  /* While the item waits in pending_uploads for a texture of this tier: */
+  gboolean upload_pending;
+  ItemTier upload_tier;
+  gsize upload_bytes;
+}
+Item;
+
+Item* item_at_front = NULL;
+
+/* In the virtual mode, there is only a fixed number of actors (slots),
+ * enough to fill the ellipse once, and they are bound to the items that
+ * are near the front as the ellipse rotates. The other items have no actor,
+ * so their Item is all that we keep for them.
+ */
+gboolean virtual_mode = FALSE;
+
+typedef struct Slot
+{
+  ClutterActor *actor;
+  Item *item;
+}
+Slot;
+
+Slot *slots = NULL;
+guint n_slots = 0;
+
+/* The position of the item at the front, between two items while rotating: */
+gdouble virtual_front = 0;
+
+void clear_slots();
+void create_carousel_layout(guint n_actors);
+void watch_images_directory(const gchar *directory_path);
+void rotate_all_until_item_is_at_front(Item *item);
+void add_found_file(const gchar *path, const DirScannerFile *found);
+void show_found_files(gint old_front_index);
+void finish_adding_files();
+void queue_save_thumbnail_cache();
+void on_dir_scanner_files(const DirScannerFile *files, guint n_files, gpointer user_data);
+void on_dir_scanner_done(DirScanner *scanner, gpointer user_data);
+
+gboolean watch_directory = FALSE;
+gboolean recursive = FALSE;
+gboolean benchmark_layout = FALSE;
+gboolean benchmark_pipeline = FALSE;
+gchar *benchmark_thumbnails_directory = NULL;
+gboolean cull_occluded = FALSE;
+
+/* For measuring a scripted series of rotations with synthetic images: */
+gint benchmark_n_images = 0;
+gchar *benchmark_image_size = NULL;
+gint benchmark_n_rotations = 20;
+Benchmark *benchmark = NULL;
+gint benchmark_rotation = 0;
+gboolean benchmark_thumbnails_loaded = FALSE;
+gboolean benchmark_frame_started = FALSE;
+guint64 benchmark_n_culled = 0;
+guint benchmark_n_painted_frames = 0;
+
+/* Where to keep the thumbnails, or NULL for the default file: */
+gchar *thumbnail_cache_filepath = NULL;
+
+/* For keeping the textures within a budget, by replacing the textures of
+ * the items that have been out of view for longest with placeholders:
+ */
+gint texture_budget_mb = 64;
+gsize resident_texture_bytes = 0; /* Not counting the atlas pages. */
+guint n_texture_evictions = 0;
+guint n_texture_reloads = 0;
+
+/* The items that have textures, the most recently seen first: */
+GQueue lru_items = G_QUEUE_INIT;
+
+/* For spreading the uploads of new textures over several frames, so that
+ * a directory of cached thumbnails does not stall one frame for a long time.
+ * The items wait in pending_uploads, and before each frame the ones nearest
+ * the front are uploaded, until upload_budget_ms has been spent:
+ */
+gint upload_budget_ms = 4;
+GPtrArray *pending_uploads = NULL;
+gsize pending_upload_bytes = 0;
+gsize peak_pending_upload_bytes = 0;
+gboolean pending_uploads_sorted = FALSE;
+gint pending_uploads_front = 0;
+gboolean running_uploads = FALSE;
+guint upload_frame_source_id = 0;
+GTimer *upload_timer = NULL;
+gdouble last_upload_time = 0;
+
+/* Incremented for each frame of the rotation,
+ * so we know which items are in view now:
+ */
+guint frame_counter = 1;
+
+static GOptionEntry option_entries[] =
+{
+  { "virtual", 0, 0, G_OPTION_ARG_NONE, &virtual_mode,
+    "Only create actors for the images that fit on the ellipse", NULL },
+  { "recursive", 0, 0, G_OPTION_ARG_NONE, &recursive,
+    "Load the images in all the subdirectories too, scanning them in parallel", NULL },
+  { "watch", 0, 0, G_OPTION_ARG_NONE, &watch_directory,
+    "Add, remove and reload images when their files change", NULL },
+  { "cull-occluded", 0, 0, G_OPTION_ARG_NONE, &cull_occluded,
+    "Don't paint images that are hidden behind opaque images", NULL },
+  { "texture-budget", 0, 0, G_OPTION_ARG_INT, &texture_budget_mb,
+    "Keep the textures of the images under this size, or 0 for no limit", "MB" },
+  { "upload-budget", 0, 0, G_OPTION_ARG_INT, &upload_budget_ms,
+    "Spend about this long uploading new textures in each frame (default 4), or 0 for no limit", "MS" },
+  { "benchmark", 0, 0, G_OPTION_ARG_INT, &benchmark_n_images,
+    "Rotate through this many generated images, print the timings as JSON, and exit", "N" },
+  { "benchmark-image-size", 0, 0, G_OPTION_ARG_STRING, &benchmark_image_size,
+    "The size of the generated images (default 1600x1200)", "WIDTHxHEIGHT" },
+  { "benchmark-rotations", 0, 0, G_OPTION_ARG_INT, &benchmark_n_rotations,
+    "The number of rotations to measure (default 20)", "N" },
+  { "benchmark-layout", 0, 0, G_OPTION_ARG_NONE, &benchmark_layout,
+    "Measure the time taken to lay out different numbers of items, and exit", NULL },
+  { "benchmark-pipeline", 0, 0, G_OPTION_ARG_NONE, &benchmark_pipeline,
+    "Measure how fast decoded images are made into thumbnails, and exit", NULL },
+  { "benchmark-thumbnails", 0, 0, G_OPTION_ARG_FILENAME, &benchmark_thumbnails_directory,
+    "Measure making thumbnails of the images in this directory, with and without decoding shortcuts, and exit", "DIRECTORY" },
+  { NULL }
+};
+
+/* The items, in the order in which they are arranged around the ellipse.
+ * Each item knows its own index in this array, so we never need to search it.
+ */
+GPtrArray *items = NULL;
+
+/* The same items, by their ItemPath,
+ * so we can find them when their files change:
+ */
+GHashTable *items_by_path = NULL;
+
+/* The items and their paths are allocated together in this arena, and freed
+ * together when the images are loaded again. The items that have been removed
+ * are kept in free_items, to be used again.
+ */
+Arena *item_arena = NULL;
+GTrashStack *free_items = NULL;
+
+/* The items are added as their files are found, so the first images can be
+ * shown before the whole directory has been read. In the recursive mode,
+ * the scanner finds the files. Otherwise we read the directory in an idle
+ * handler, a slice of at most READ_DIRECTORY_SLICE_MS at a time, so that
+ * frames can be drawn in between.
+ */
+#define READ_DIRECTORY_SLICE_MS 5
+DirScanner *dir_scanner = NULL;
+GDir *read_dir = NULL;
+guint read_dir_source_id = 0;
+GTimer *read_dir_timer = NULL;
+gchar *scan_directory_path = NULL;
+gdouble scan_entries_per_second = 0;
+
+/* The time from when we start loading the images until the first one is
+ * shown, which should not depend on how many files there are:
+ */
+GTimer *startup_timer = NULL;
+gdouble first_image_seconds = -1;
+
+/* The files that were not images, for each reason: */
+guint n_skipped_files[IMAGE_SNIFF_N_RESULTS] = { 0 };
+guint n_skipped_files_total = 0;
+
+/* For adding, removing and reloading items when their files change: */
+gchar *images_directory = NULL;
+GFileMonitor *directory_monitor = NULL;
+
+/* The filenames that have changed, collected for a short time,
+ * so that we can handle many changes at once:
+ */
+GHashTable *pending_changes = NULL;
+guint pending_changes_source = 0;
+const guint PENDING_CHANGES_DELAY = 200; /* milliseconds */
+
+Item* get_item(guint index)
+{
+  return (Item*)g_ptr_array_index (items, index);
+}
+
+/* Forget about the item's texture, which has been freed or is about to be: */
+void release_item_texture(Item *item)
+{
+  if(item->lru_link.data)
+  {
+    g_queue_unlink (&lru_items, &item->lru_link);
+    item->lru_link.data = NULL;
+  }
+
+  resident_texture_bytes -= item->texture_bytes;
+  item->texture_bytes = 0;
+  item->has_texture = FALSE;
+}
+
+/* Move the item to the front of lru_items, so its texture is dropped last: */
+void touch_item_texture(Item *item)
+{
+  if(!item->has_texture)
+    return;
+
+  if(item->lru_link.data)
+    g_queue_unlink (&lru_items, &item->lru_link);
+
+  item->lru_link.data = item;
+  g_queue_push_head_link (&lru_items, &item->lru_link);
+}
+
+/* Replace the item's texture with a placeholder of the same size: */
+void evict_item_texture(Item *item)
+{
+  gint width = 0;
+  gint height = 0;
+  example_atlas_image_get_base_size (EXAMPLE_ATLAS_IMAGE (item->actor), &width, &height);
+  example_atlas_image_set_placeholder (EXAMPLE_ATLAS_IMAGE (item->actor), width, height);
+
+  release_item_texture (item);
+  item->tier = ITEM_TIER_NONE;
+  item->evicted = TRUE;
+  ++n_texture_evictions;
+}
+
+/* The texture memory that we use, including the whole of each atlas page,
+ * however much of it is used:
+ */
+gsize get_texture_bytes()
+{
+  gsize bytes = resident_texture_bytes;
+  if(texture_atlas)
+    bytes += texture_atlas_get_bytes (texture_atlas);
+
+  return bytes;
+}
+
+/* Drop the textures of the items that have been out of view for longest,
+ * until we are within the budget. The items that are in view now keep their
+ * textures, even if that takes us over the budget.
+ */
+void enforce_texture_budget()
+{
+  const gsize budget = (gsize)texture_budget_mb * 1024 * 1024;
+  if(!budget)
+    return;
+
+  while(get_texture_bytes () > budget)
+  {
+    GList *link = g_queue_peek_tail_link (&lru_items);
+    if(!link)
+      break;
+
+    Item *item = (Item*)link->data;
+    if(item->visible_frame == frame_counter)
+      break;
+
+    const gsize bytes = get_texture_bytes ();
+    evict_item_texture (item);
+
+    /* Dropping a thumbnail from an atlas page only releases the page if it was
+     * the last one there. Sparse pages are merged when the main loop is idle,
+     * so wait for that instead of dropping every thumbnail that is out of view:
+     */
+    if(get_texture_bytes () >= bytes)
+      break;
+  }
+}
+
+/* Like %, but never negative: */
+gint positive_modulo(gint a, gint b)
+{
+  const gint result = a % b;
+  return result < 0 ? result + b : result;
+}
+
+/* The whole path, in a buffer that is overwritten by the next call: */
+const gchar* get_item_filepath(Item *item)
+{
+  static GString *buffer = NULL;
+  if(!buffer)
+    buffer = g_string_sized_new (256);
+
+  g_string_assign (buffer, item->path.directory);
+  if(item->path.name)
+    g_string_append (buffer, item->path.name);
+
+  return buffer->str;
+}
+
+/* Like g_str_hash(), for the whole path: */
+guint item_path_hash(gconstpointer key)
+{
+  const ItemPath *path = (const ItemPath*)key;
+
+  guint hash = 5381;
+  const gchar *p = NULL;
+  for (p = path->directory; *p; ++p)
+    hash = (hash << 5) + hash + *p;
+
+  if(path->name)
+  {
+    for (p = path->name; *p; ++p)
+      hash = (hash << 5) + hash + *p;
+  }
+
+  return hash;
+}
+
+/* Like g_str_equal(), for the whole paths: */
+gboolean item_path_equal(gconstpointer a, gconstpointer b)
+{
+  const ItemPath *path_a = (const ItemPath*)a;
+  const ItemPath *path_b = (const ItemPath*)b;
+
+  const gchar *pa = path_a->directory;
+  const gchar *pb = path_b->directory;
+  const gchar *next_a = path_a->name;
+  const gchar *next_b = path_b->name;
+  while(TRUE)
+  {
+    /* Continue with the name after the directory: */
+    if(!*pa && next_a)
+    {
+      pa = next_a;
+      next_a = NULL;
+      continue;
+    }
+
+    if(!*pb && next_b)
+    {
+      pb = next_b;
+      next_b = NULL;
+      continue;
+    }
+
+    if(*pa != *pb)
+      return FALSE;
+
+    if(!*pa)
+      return TRUE;
+
+    ++pa;
+    ++pb;
+  }
+}
+
+Item* get_item_by_path(const gchar *filepath)
+{
+  const ItemPath path = { filepath, NULL };
+  return (Item*)g_hash_table_lookup (items_by_path, &path);
+}
+
+/* An estimate of the size of a g_malloc() of this size, with its header: */
+gsize get_malloc_size(gsize size)
+{
+  return MAX (32, (size + 8 + 15) & ~(gsize)15);
+}
+
+static gboolean
+on_idle_request_upload_frame (gpointer data G_GNUC_UNUSED)
+{
+  upload_frame_source_id = 0;
+  clutter_actor_queue_redraw (stage);
+
+  return FALSE; /* Don't call this again. */
+}
+
+/* Make sure that there is another frame, after this one,
+ * in which to upload the waiting textures:
+ */
+void request_upload_frame()
+{
+  if(!upload_frame_source_id)
+    upload_frame_source_id = clutter_threads_add_idle (on_idle_request_upload_frame, NULL);
+}
+
+/* Let the item wait for its turn to get a texture of this tier: */
+void queue_item_upload(Item *item, ItemTier tier, gsize bytes)
+{
+  if(item->upload_pending)
+  {
+    /* The item at the front has no size until it has a texture, so
+     * choose_tier() would choose the smallest tier. Don't let that replace
+     * a bigger tier:
+     */
+    if(item->upload_tier >= tier)
+      return;
+
+    pending_upload_bytes -= item->upload_bytes;
+  }
+  else
+  {
+    g_ptr_array_add (pending_uploads, item);
+    pending_uploads_sorted = FALSE;
+    item->upload_pending = TRUE;
+  }
+
+  item->upload_tier = tier;
+  item->upload_bytes = bytes;
+  pending_upload_bytes += bytes;
+  peak_pending_upload_bytes = MAX (peak_pending_upload_bytes, pending_upload_bytes);
+
+  request_upload_frame ();
+}
+
+void cancel_item_upload(Item *item)
+{
+  if(!item->upload_pending)
+    return;
+
+  /* This keeps the order, so they stay sorted: */
+  g_ptr_array_remove (pending_uploads, item);
+  pending_upload_bytes -= item->upload_bytes;
+  item->upload_pending = FALSE;
+}
+
+void cancel_all_uploads()
+{
+  guint i = 0;
+  for (i = 0; i < pending_uploads->len; ++i)
+    ((Item*)g_ptr_array_index (pending_uploads, i))->upload_pending = FALSE;
+
+  g_ptr_array_set_size (pending_uploads, 0);
+  pending_upload_bytes = 0;
+}
+
+/* The bytes that malloc() has handed out, or 0 if we can't ask it: */
+gsize get_malloc_bytes_in_use()
+{
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 33)
+  struct mallinfo2 info = mallinfo2 ();
+  return info.uordblks + info.hblkhd;
+#else
+  struct mallinfo info = mallinfo ();
+  return (guint)info.uordblks + (guint)info.hblkhd;
+#endif
+#else
+  return 0;
+#endif
+}
+
+/* The memory for each item and its path, in an arena and as separate allocations.
+ * Both are measured the same way, by building copies of the items each way
+ * and asking malloc() how much more it has handed out, so that the arena's
+ * unused space, padding, and hash table of directories are counted too.
+ * Where malloc() can't tell us, the arena's blocks are counted instead,
+ * without its hash table, and glibc's overhead is estimated for the rest.
+ * This copies all the items, so it is only done for --benchmark.
+ */
+void get_item_bytes(gdouble *arena_bytes, gdouble *separate_bytes)
+{
+  *arena_bytes = 0;
+  *separate_bytes = 0;
+  if(!items || !items->len)
+    return;
+
+  gpointer *copies = g_new0 (gpointer, items->len * 2);
+  guint i = 0;
+
+  const gsize before = get_malloc_bytes_in_use ();
+  Arena *arena = arena_new ();
+  for (i = 0; i < items->len; ++i)
+  {
+    const Item *item = (const Item*)g_ptr_array_index (items, i);
+    arena_alloc0 (arena, sizeof (Item));
+    arena_intern (arena, item->path.directory, strlen (item->path.directory));
+    arena_strndup (arena, item->path.name, strlen (item->path.name));
+  }
+  const gsize after_arena = get_malloc_bytes_in_use ();
+
+  gsize separate_estimate = 0;
+  for (i = 0; i < items->len; ++i)
+  {
+    const Item *item = (const Item*)g_ptr_array_index (items, i);
+    copies[i * 2] = g_malloc0 (sizeof (Item));
+    copies[i * 2 + 1] = g_strconcat (item->path.directory, item->path.name, NULL);
+    separate_estimate += get_malloc_size (sizeof (Item)) +
+      get_malloc_size (strlen (copies[i * 2 + 1]) + 1);
+  }
+  const gsize after_separate = get_malloc_bytes_in_use ();
+
+  if(before)
+  {
+    *arena_bytes = (after_arena - before) / (gdouble)items->len;
+    *separate_bytes = (after_separate - after_arena) / (gdouble)items->len;
+  }
+  else
+  {
+    *arena_bytes = arena_get_bytes_allocated (arena) / (gdouble)items->len;
+    *separate_bytes = separate_estimate / (gdouble)items->len;
+  }
+
+  for (i = 0; i < items->len * 2; ++i)
+    g_free (copies[i]);
+  g_free (copies);
+  arena_free (arena);
+}
+
+void on_foreach_clear_items(gpointer data, gpointer user_data G_GNUC_UNUSED)
+{
+  Item* item = (Item*)data;
+  release_item_texture (item);
+  cancel_item_upload (item);
+
+  /* We don't need to unref the actor because the floating reference was taken by the stage,
+   * but we destroy it so that it is removed from the stage and gives its
+   * space in the texture atlas back.
+   * In the virtual mode, the actor belongs to a slot instead.
+   */
+  if(!virtual_mode)
+    clutter_actor_destroy (item->actor);
+
+  /* Its memory belongs to item_arena, so keep it for the next new item: */
+  g_trash_stack_push (&free_items, item);
+}
+
+void scale_texture_default(ClutterActor *texture)
+{
+  int pixbuf_height = 0;
+  example_atlas_image_get_base_size (EXAMPLE_ATLAS_IMAGE (texture), NULL, &pixbuf_height);
+
+  const gdouble scale = pixbuf_height ? IMAGE_HEIGHT /  (gdouble)pixbuf_height : 0;
+  clutter_actor_set_scale (texture, scale, scale);
+}
+
+/* Whether none of the RGBA pixels are transparent: */
+gboolean get_pixels_are_opaque(const guchar *pixels, gint width, gint height, gint rowstride)
+{
+  gint y = 0;
+  for (y = 0; y < height; ++y)
+  {
+    const guchar *row = pixels + y * rowstride;
+    gint x = 0;
+    for (x = 0; x < width; ++x)
+    {
+      if(row[x * 4 + 3] != 0xff)
+        return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Put pixels of one of the tiers in the item's texture,
+ * without changing the size at which the item is shown.
+ */
+void set_item_pixels(Item *item, ItemTier tier, const guchar *pixels, gboolean has_alpha,
+  gint width, gint height, gint rowstride)
+{
+  /* In the virtual mode, only items in a slot have an actor: */
+  if(!item->actor)
+    return;
+
+  /* It doesn't need to wait for a texture now: */
+  cancel_item_upload (item);
+
+  gint old_height = 0;
+  example_atlas_image_get_base_size (EXAMPLE_ATLAS_IMAGE (item->actor), NULL, &old_height);
+  gdouble old_scale = 0;
+  clutter_actor_get_scale (item->actor, &old_scale, NULL);
+
+  /* Put the thumbnail tiers in the atlas, so they can be drawn together.
+   * The full-size image gets a texture of its own.
+   */
+  TextureAtlasRegion *region = NULL;
+  if(texture_atlas && has_alpha && tier <= ITEM_TIER_THUMBNAIL)
+    region = texture_atlas_add (texture_atlas, pixels, width, height, rowstride);
+
+  if(region)
+    example_atlas_image_set_region (EXAMPLE_ATLAS_IMAGE (item->actor), region);
+  else
+  {
+    /* The thumbnail tiers are premultiplied already, but the full-size image is not: */
+    CoglPixelFormat format = COGL_PIXEL_FORMAT_RGB_888;
+    if(has_alpha)
+      format = tier <= ITEM_TIER_THUMBNAIL ? COGL_PIXEL_FORMAT_RGBA_8888_PRE : COGL_PIXEL_FORMAT_RGBA_8888;
+
+    CoglHandle texture = cogl_texture_new_from_data (width, height,
+      COGL_TEXTURE_NONE, format, COGL_PIXEL_FORMAT_ANY, rowstride, pixels);
+    if(texture == COGL_INVALID_HANDLE)
+    {
+      g_warning("cogl_texture_new_from_data() failed for %s\n", get_item_filepath (item));
+      return;
+    }
+
+    example_atlas_image_set_cogl_texture (EXAMPLE_ATLAS_IMAGE (item->actor), texture);
+    cogl_handle_unref (texture);
+  }
+
+  item->tier = tier;
+
+  /* It is drawn in the next frame: */
+  if(first_image_seconds < 0 && startup_timer)
+  {
+    first_image_seconds = g_timer_elapsed (startup_timer, NULL);
+    g_print ("First image shown after %.3f seconds\n", first_image_seconds);
+    if(benchmark)
+      benchmark_mark (benchmark, "first_image_ms");
+  }
+
+  /* Let it hide the items behind it, if it has no transparent parts.
+   * The thumbnails always have alpha, but they are small enough to check:
+   */
+  const gboolean opaque = !has_alpha ||
+    (tier <= ITEM_TIER_THUMBNAIL && get_pixels_are_opaque (pixels, width, height, rowstride));
+  example_carousel_group_set_occluder (EXAMPLE_CAROUSEL_GROUP (carousel_group),
+    item->actor, opaque);
+
+  /* Keep count of the texture memory: */
+  release_item_texture (item);
+  item->has_texture = TRUE;
+  item->texture_bytes = region ? 0 : (gsize)width * height * 4;
+  resident_texture_bytes += item->texture_bytes;
+  touch_item_texture (item);
+
+  if(item->evicted)
+  {
+    item->evicted = FALSE;
+    ++n_texture_reloads;
+  }
+
+  /* Make sure that all images are shown with the same height,
+   * or keep the current height if the item is already being shown:
+   */
+  if(old_height && old_scale)
+  {
+    const gdouble scale = old_scale * old_height / height;
+    clutter_actor_set_scale (item->actor, scale, scale);
+  }
+  else
+    scale_texture_default (item->actor);
+}
+
+/* Put RGBA thumbnail pixels in the item's texture: */
+void set_item_thumbnail(Item *item, const guchar *pixels, gint width, gint height, gint rowstride)
+{
+  set_item_pixels (item, ITEM_TIER_THUMBNAIL, pixels, TRUE, width, height, rowstride);
+}
+
+gint get_tier_height(ItemTier tier)
+{
+  switch(tier)
+  {
+    case ITEM_TIER_QUARTER:
+      return IMAGE_HEIGHT / 4;
+    case ITEM_TIER_HALF:
+      return IMAGE_HEIGHT / 2;
+    case ITEM_TIER_THUMBNAIL:
+      return IMAGE_HEIGHT;
+    default:
+      return 0;
+  }
+}
+
+/* The distance of the viewpoint from the stage, in pixels, for the stage's
+ * perspective, which shows things at a depth of 0 at their own size.
+ * This is updated for each frame of the rotation:
+ */
+gdouble viewpoint_distance = 1000;
+
+void update_viewpoint_distance()
+{
+  ClutterPerspective perspective;
+  clutter_stage_get_perspective (CLUTTER_STAGE (stage), &perspective);
+  viewpoint_distance = clutter_actor_get_height (stage) / 2 /
+    tan (perspective.fovy * G_PI / 360);
+}
+
+/* Choose the smallest tier that is not smaller than the item's height on the
+ * screen, at this depth. The item must get a bit smaller than a tier before we use the
+ * smaller tier, so that we don't keep switching between two tiers.
+ */
+ItemTier choose_tier(Item *item, gfloat depth)
+{
+  if(!item->actor)
+    return ITEM_TIER_NONE;
+
+  /* The items on the ellipse are all IMAGE_HEIGHT high, so only the
+   * perspective changes their height on the screen, which we can calculate
+   * without asking Clutter to transform each actor. The item at the front
+   * might have been moved up and made bigger, so we ask for that one:
+   */
+  gfloat projected_height = 0;
+  if(item == item_at_front)
+    clutter_actor_get_transformed_size (item->actor, NULL, &projected_height);
+  else
+    projected_height = IMAGE_HEIGHT * viewpoint_distance /
+      MAX (viewpoint_distance - depth, 1);
+
+  ItemTier tier = ITEM_TIER_THUMBNAIL;
+  while(tier > ITEM_TIER_QUARTER)
+  {
+    const ItemTier smaller = tier - 1;
+    gdouble limit = get_tier_height (smaller);
+    if(item->tier > smaller)
+      limit *= 0.9;
+
+    if(projected_height > limit)
+      break;
+
+    tier = smaller;
+  }
+
+  return tier;
+}
+
+/* Make one of the smaller tiers from the thumbnail: */
+void set_item_tier(Item *item, ItemTier tier)
+{
+  if(!item->actor || !item->has_thumbnail || tier == item->tier ||
+     tier == ITEM_TIER_NONE || tier > ITEM_TIER_THUMBNAIL)
+    return;
+
+  /* The thumbnail cache keeps the thumbnail pixels for us,
+   * so we don't need to keep them in memory:
+   */
+  gint width = 0;
+  gint rowstride = 0;
+  const guchar *pixels = thumbnail_cache_lookup (thumbnail_cache,
+    get_item_filepath (item), IMAGE_HEIGHT, &width, &rowstride);
+  if(!pixels)
+    return;
+
+  /* New textures wait for their turn, unless their turn is now: */
+  const gint height = get_tier_height (tier);
+  const gint tier_width = MAX (1, width * height / IMAGE_HEIGHT);
+  if(item->tier == ITEM_TIER_NONE && upload_budget_ms > 0 && !running_uploads)
+  {
+    queue_item_upload (item, tier, (gsize)tier_width * height * 4);
+    return;
+  }
+
+  if(tier == ITEM_TIER_THUMBNAIL)
+  {
+    set_item_thumbnail (item, pixels, width, IMAGE_HEIGHT, rowstride);
+    return;
+  }
+
+  /* The thumbnail is premultiplied already: */
+  guchar *scaled = g_malloc (tier_width * 4 * height);
+  image_pipeline_scale (pixels, width, IMAGE_HEIGHT, rowstride, TRUE, FALSE,
+    scaled, tier_width, height, tier_width * 4);
+
+  set_item_pixels (item, tier, scaled, TRUE, tier_width, height, tier_width * 4);
+  g_free (scaled);
+}
+
+/* How far the item is from the front of the ellipse, counting in either direction: */
+gint get_upload_distance(const Item *item)
+{
+  const gint count = items->len;
+  const gint distance = positive_modulo ((gint)item->index - pending_uploads_front, count);
+  return MIN (distance, count - distance);
+}
+
+static gint
+compare_upload_distances (gconstpointer a, gconstpointer b)
+{
+  const gint distance_a = get_upload_distance (*(Item* const*)a);
+  const gint distance_b = get_upload_distance (*(Item* const*)b);
+  return distance_a - distance_b;
+}
+
+/* This is called before each frame is painted, to upload the textures
+ * of the items nearest the front, until the upload budget has been spent:
+ */
+static gboolean
+on_repaint_run_pending_uploads (gpointer data G_GNUC_UNUSED)
+{
+  last_upload_time = 0;
+  if(!pending_uploads->len)
+    return TRUE; /* Keep calling this. */
+
+  const gint front = item_at_front ? (gint)item_at_front->index : 0;
+  if(!pending_uploads_sorted || front != pending_uploads_front)
+  {
+    pending_uploads_front = front;
+    g_ptr_array_sort (pending_uploads, compare_upload_distances);
+    pending_uploads_sorted = TRUE;
+  }
+
+  /* Always upload at least one, so that we get through them eventually: */
+  const gdouble budget = upload_budget_ms / 1000.0;
+  g_timer_start (upload_timer);
+  running_uploads = TRUE;
+  guint n_uploaded = 0;
+  while(n_uploaded < pending_uploads->len &&
+        (n_uploaded == 0 || g_timer_elapsed (upload_timer, NULL) < budget))
+  {
+    Item *item = (Item*)g_ptr_array_index (pending_uploads, n_uploaded);
+    ++n_uploaded;
+
+    item->upload_pending = FALSE;
+    pending_upload_bytes -= item->upload_bytes;
+    set_item_tier (item, item->upload_tier);
+  }
+  running_uploads = FALSE;
+  g_ptr_array_remove_range (pending_uploads, 0, n_uploaded);
+
+  enforce_texture_budget ();
+
+  last_upload_time = g_timer_elapsed (upload_timer, NULL);
+  if(benchmark)
+    benchmark_add_sample (benchmark, BENCHMARK_SAMPLE_UPLOAD, last_upload_time);
+
+  if(pending_uploads->len)
+    request_upload_frame ();
+
+  return TRUE; /* Keep calling this. */
+}
+
+static void
+get_upload_stats (gdouble *upload_time, gsize *queued_bytes, gpointer user_data G_GNUC_UNUSED)
+{
+  *upload_time = last_upload_time;
+  *queued_bytes = pending_upload_bytes;
+}
+
+/* Show the full-size image of the item at the front: */
+void show_full_image(Item *item, GdkPixbuf *pixbuf)
+{
+  gint old_height = 0;
+  example_atlas_image_get_base_size (EXAMPLE_ATLAS_IMAGE (item->actor), NULL, &old_height);
+
+  set_item_pixels (item, ITEM_TIER_FULL, gdk_pixbuf_get_pixels (pixbuf),
+    gdk_pixbuf_get_has_alpha (pixbuf),
+    gdk_pixbuf_get_width (pixbuf), gdk_pixbuf_get_height (pixbuf),
+    gdk_pixbuf_get_rowstride (pixbuf));
+  enforce_texture_budget ();
+
+  /* If it is still moving up then the scale behaviour must use the
+   * new texture size too:
+   */
+  if(clutter_timeline_is_playing (timeline_moveup) && old_height)
+  {
+    const gdouble ratio = old_height / (gdouble)gdk_pixbuf_get_height (pixbuf);
+    gdouble x_start = 0, y_start = 0, x_end = 0, y_end = 0;
+    clutter_behaviour_scale_get_bounds (CLUTTER_BEHAVIOUR_SCALE (behaviour_scale),
+      &x_start, &y_start, &x_end, &y_end);
+    clutter_behaviour_scale_set_bounds (CLUTTER_BEHAVIOUR_SCALE (behaviour_scale),
+      x_start * ratio, y_start * ratio, x_end * ratio, y_end * ratio);
+  }
+}
+
+/* This is called in the main loop when the full-size image of the item
+ * that is rotating to the front has been decoded.
+ */
+void on_full_image_loaded(const gchar *filepath, GdkPixbuf *pixbuf, gpointer user_data G_GNUC_UNUSED)
+{
+  /* Ignore it if we don't want it any more: */
+  if(!pixbuf || !g_hash_table_lookup_extended (full_images, filepath, NULL, NULL))
+    return;
+
+  g_hash_table_replace (full_images, g_strdup (filepath), g_object_ref (pixbuf));
+
+  /* Show it now if the move up has already started: */
+  Item *item = get_item_by_path (filepath);
+  if(item && item == item_at_front && !clutter_timeline_is_playing (timeline_rotation))
+    show_full_image (item, pixbuf);
+}
+
+void on_full_images_value_destroy(gpointer data)
+{
+  if(data)
+    g_object_unref (data);
+}
+
+/* Start decoding the full-size image, if we have not already: */
+void prefetch_full_image(Item *item, gint priority)
+{
+  const gchar *filepath = get_item_filepath (item);
+  if(!image_loader || g_hash_table_lookup_extended (full_images, filepath, NULL, NULL))
+    return;
+
+  /* NULL until it has been decoded: */
+  g_hash_table_insert (full_images, g_strdup (filepath), NULL);
+  image_loader_queue (image_loader, filepath, 0 /* full size */,
+    priority, on_full_image_loaded, NULL);
+}
+
+static gboolean
+on_full_images_foreach_remove_other (gpointer key, gpointer value G_GNUC_UNUSED, gpointer user_data)
+{
+  return get_item_by_path ((const gchar*)key) != (Item*)user_data;
+}
+
+/* Decode the item's full-size image while the ellipse rotates, so it is ready
+ * when the item is moved up, and forget the other full-size images:
+ */
+void prefetch_full_image_of_front(Item *item)
+{
+  g_hash_table_foreach_remove (full_images, on_full_images_foreach_remove_other, item);
+
+  /* Before any thumbnails: */
+  prefetch_full_image (item, -2);
+}
+
+void save_thumbnail_cache()
+{
+  if(save_thumbnail_cache_source)
+  {
+    g_source_remove (save_thumbnail_cache_source);
+    save_thumbnail_cache_source = 0;
+  }
+
+  if(!thumbnail_cache || !thumbnail_cache_is_dirty (thumbnail_cache))
+    return;
+
+  GError *error = NULL;
+  thumbnail_cache_save (thumbnail_cache, &error);
+  if(error)
+  {
+    g_warning("thumbnail_cache_save() failed: %s\n", error->message);
+    g_clear_error(&error);
+  }
+}
+
+/* This is called in the main loop when a worker thread has decoded an image: */
+void on_image_loaded(const gchar *filepath, GdkPixbuf *pixbuf, gpointer user_data G_GNUC_UNUSED)
+{
+  /* Find the item by its filepath, because it might have been removed since: */
+  Item *item = get_item_by_path (filepath);
+  if(item)
+    item->thumbnail_requested = FALSE;
+
+  if(item && pixbuf)
+  {
+    item->has_thumbnail = TRUE;
+    if(thumbnail_cache)
+      thumbnail_cache_add (thumbnail_cache, filepath, IMAGE_HEIGHT, pixbuf);
+
+    /* A new texture waits for its turn, but a reloaded one replaces
+     * the old texture at once:
+     */
+    if(thumbnail_cache && item->tier == ITEM_TIER_NONE)
+      set_item_tier (item, ITEM_TIER_THUMBNAIL);
+    else
+      set_item_thumbnail (item, gdk_pixbuf_get_pixels (pixbuf),
+        gdk_pixbuf_get_width (pixbuf), gdk_pixbuf_get_height (pixbuf),
+        gdk_pixbuf_get_rowstride (pixbuf));
+
+    enforce_texture_budget ();
+  }
+
+  /* Write the new thumbnails to disk a while after we have them all: */
+  --pending_image_loads;
+  if(pending_image_loads == 0)
+  {
+    if(benchmark && !benchmark_thumbnails_loaded)
+    {
+      benchmark_mark (benchmark, "thumbnails_ms");
+      benchmark_thumbnails_loaded = TRUE;
+    }
+
+    queue_save_thumbnail_cache ();
+  }
+}
+
+static gboolean
+on_save_thumbnail_cache_timeout (gpointer data G_GNUC_UNUSED)
+{
+  save_thumbnail_cache_source = 0;
+  save_thumbnail_cache ();
+
+  return FALSE; /* Don't call this again. */
+}
+
+/* Save the cache when no more thumbnails have been made for a while,
+ * or at exit, whichever is first:
+ */
+void queue_save_thumbnail_cache()
+{
+  if(save_thumbnail_cache_source)
+    g_source_remove (save_thumbnail_cache_source);
+
+  save_thumbnail_cache_source = clutter_threads_add_timeout (SAVE_THUMBNAIL_CACHE_DELAY,
+    on_save_thumbnail_cache_timeout, NULL);
+}
+
+/* This is called when the atlas has moved some thumbnails around: */
+void on_texture_atlas_changed(TextureAtlas *atlas G_GNUC_UNUSED, gpointer user_data G_GNUC_UNUSED)
+{
+  clutter_actor_queue_redraw (stage);
+}
+
+/* Decode the item's thumbnail if we don't have it yet: */
+void request_item_thumbnail(Item *item, gint priority)
+{
+  if(item->has_thumbnail || item->thumbnail_requested || !image_loader)
+    return;
+
+  image_loader_queue (image_loader, get_item_filepath (item), IMAGE_HEIGHT,
+    priority, on_image_loaded, NULL);
+  item->thumbnail_requested = TRUE;
+  ++pending_image_loads;
+}
+
+/* Items near the front of the ellipse are decoded first.
+ * The first item is at the front, and the ones before and after it
+ * (at the end and the start of the array) are its neighbours.
+ */
+gint get_load_priority(gint pos, gint count)
+{
+  const gint distance_after = pos;
+  const gint distance_before = count - pos;
+  return MIN (distance_after, distance_before);
+}
+
+/* Create an item for this file, if it is an image,
+ * and add it to the end of the array.
+ * found, if not NULL, is the file as the scanner found it, which has
+ * already been checked, so we don't need to read or stat() it again.
+ * result, if not NULL, says why the file was skipped, if it was.
+ */
+Item* add_item(const gchar *path, const DirScannerFile *found, ImageSniffResult *result)
+{
+  gint width = 0;
+  gint rowstride = 0;
+  const guchar *pixels = found ?
+    thumbnail_cache_lookup_stat (thumbnail_cache, path, found->file_size,
+      found->file_mtime, IMAGE_HEIGHT, &width, &rowstride) :
+    thumbnail_cache_lookup (thumbnail_cache, path, IMAGE_HEIGHT, &width, &rowstride);
+
+  /* Otherwise check that the file is an image, by reading just the first
+   * few bytes, without asking the image loaders.
+   * The texture stays empty until the image has been decoded.
+   */
+  const ImageSniffResult sniff_result = (pixels || found) ?
+    IMAGE_SNIFF_OK : image_sniffer_check_file (path, NULL);
+  if(result)
+    *result = sniff_result;
+
+  if(sniff_result != IMAGE_SNIFF_OK)
+    return NULL;
+
+  /* Use the memory of a removed item, if there is one: */
+  Item* item = (Item*)g_trash_stack_pop (&free_items);
+  gchar *old_name = NULL;
+  if(item)
+  {
+    old_name = item->path.name;
+    memset (item, 0, sizeof (Item));
+  }
+  else
+    item = (Item*)arena_alloc0 (item_arena, sizeof (Item));
+
+  /* In the virtual mode, the item gets an actor only when it is in a slot: */
+  if(!virtual_mode)
+    item->actor = example_atlas_image_new ();
+
+  /* The items in the same directory share one copy of it: */
+  const gchar *name = strrchr (path, G_DIR_SEPARATOR);
+  name = name ? name + 1 : path;
+  item->path.directory = arena_intern (item_arena, path, name - path);
+
+  /* Use the removed item's name too, if the new one fits, so that the arena
+   * doesn't grow each time that a file is added and removed in --watch mode.
+   * A name that doesn't fit still takes new memory, until the next reload:
+   */
+  const gsize name_length = strlen (name);
+  if(old_name && strlen (old_name) >= name_length)
+  {
+    memcpy (old_name, name, name_length + 1);
+    item->path.name = old_name;
+  }
+  else
+    item->path.name = arena_strndup (item_arena, name, name_length);
+
+  item->index = items->len;
+  g_ptr_array_add (items, item);
+  g_hash_table_insert (items_by_path, &item->path, item);
+
+  /* This waits for its turn to be uploaded: */
+  if(pixels)
+  {
+    item->has_thumbnail = TRUE;
+    set_item_tier (item, ITEM_TIER_THUMBNAIL);
+  }
+
+  return item;
+}
+
+void print_skipped_files(const gchar *directory_path)
+{
+  if(!n_skipped_files_total)
+    return;
+
+  g_print ("Skipped %u of %u files in %s:\n", n_skipped_files_total,
+    n_skipped_files_total + items->len, directory_path);
+
+  guint i = 0;
+  for (i = 0; i < IMAGE_SNIFF_N_RESULTS; ++i)
+  {
+    if(n_skipped_files[i])
+      g_print ("  %u %s\n", n_skipped_files[i], image_sniffer_result_to_string (i));
+  }
+}
+
+/* Stop reading the directory, if we have not finished: */
+void stop_reading_directory()
+{
+  if(read_dir_source_id)
+  {
+    g_source_remove (read_dir_source_id);
+    read_dir_source_id = 0;
+  }
+
+  if(read_dir)
+  {
+    g_dir_close (read_dir);
+    read_dir = NULL;
+  }
+}
+
+/* Read the next few files in the directory, and add the images among them: */
+static gboolean
+on_idle_read_directory (gpointer data G_GNUC_UNUSED)
+{
+  const gint old_front_index = item_at_front ? (gint)item_at_front->index : 0;
+  const gdouble slice = READ_DIRECTORY_SLICE_MS / 1000.0;
+  g_timer_start (read_dir_timer);
+
+  /* Checking that a file is an image takes a read(), so this is much
+   * cheaper than what we do for each file:
+   */
+  const gchar* filename = NULL;
+  while ( (filename = g_dir_read_name (read_dir)) )
+  {
+    gchar* path = g_build_filename (scan_directory_path, filename, NULL);
+    add_found_file (path, NULL);
+    g_free (path);
+
+    if(g_timer_elapsed (read_dir_timer, NULL) >= slice)
+      break;
+  }
+
+  show_found_files (old_front_index);
+
+  if(filename)
+    return TRUE; /* Call this again. */
+
+  read_dir_source_id = 0;
+  stop_reading_directory ();
+  finish_adding_files ();
+
+  return FALSE; /* Don't call this again. */
+}
+
+void load_images(const gchar* directory_path)
+{
+  g_return_if_fail(directory_path);
+
+  /* Don't bother finding or decoding any images that we are about to clear: */
+  stop_reading_directory ();
+  if(dir_scanner)
+  {
+    dir_scanner_free (dir_scanner);
+    dir_scanner = NULL;
+  }
+  if(image_loader)
+    image_loader_cancel_all (image_loader);
+  pending_image_loads = 0;
+
+  /* Clear any existing images: */
+  cancel_all_uploads ();
+  clear_slots ();
+  item_at_front = NULL;
+  virtual_front = 0;
+  if(carousel_layout)
+    create_carousel_layout (0);
+  if(items)
+  {
+    g_hash_table_destroy (items_by_path);
+    g_ptr_array_foreach (items, on_foreach_clear_items, NULL);
+    g_ptr_array_free (items, TRUE);
+  }
+
+  /* Free all the items and their paths at once: */
+  if(item_arena)
+    arena_free (item_arena);
+  item_arena = arena_new ();
+  free_items = NULL;
+
+  if(full_images)
+    g_hash_table_remove_all (full_images);
+  else
+    full_images = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, on_full_images_value_destroy);
+
+  /* Create a new array: */
+  items = g_ptr_array_new ();
+  items_by_path = g_hash_table_new (item_path_hash, item_path_equal);
+  
+  if(!texture_atlas)
+    texture_atlas = texture_atlas_new (ATLAS_PAGE_SIZE, on_texture_atlas_changed, NULL);
+
+  /* Use the cached thumbnails where we have them: */
+  if(!thumbnail_cache)
+  {
+    gchar *cache_filepath = thumbnail_cache_filepath ?
+      g_strdup (thumbnail_cache_filepath) : thumbnail_cache_get_default_filepath ();
+    thumbnail_cache = thumbnail_cache_new (cache_filepath);
+    g_free (cache_filepath);
+  }
+
+  if(!image_loader)
+    image_loader = image_loader_new ();
+
+  /* Count the files that are not images, for each reason: */
+  memset (n_skipped_files, 0, sizeof (n_skipped_files));
+  n_skipped_files_total = 0;
+
+  g_free (scan_directory_path);
+  scan_directory_path = g_strdup (directory_path);
+
+  if(watch_directory)
+    watch_images_directory (directory_path);
+
+  /* In the recursive mode, the scanner's threads find the files,
+   * and on_dir_scanner_files() adds them as they are found:
+   */
+  if(recursive)
+  {
+    dir_scanner = dir_scanner_new (directory_path,
+      on_dir_scanner_files, on_dir_scanner_done, NULL);
+    return;
+  }
+
+  /* Otherwise discover the images in the directory a few at a time: */
+  GError *error = NULL;
+  read_dir = g_dir_open (directory_path, 0, &error);
+  if(error)
+  {
+    g_warning("g_dir_open() failed: %s\n", error->message);
+    g_clear_error(&error);
+    finish_adding_files ();
+    return;
+  }
+
+  if(!read_dir_timer)
+    read_dir_timer = g_timer_new ();
+  read_dir_source_id = clutter_threads_add_idle (on_idle_read_directory, NULL);
+}
+
+
+/* Create the layout for this many actors, and the array of them: */
+void create_carousel_layout(guint n_actors)
+{
+  if(!carousel_layout)
+    carousel_layout = carousel_layout_new (320, ELLIPSE_Y, /* x, y */
+      ELLIPSE_HEIGHT, ELLIPSE_HEIGHT); /* width, height */
+
+  carousel_layout_set_n_items (carousel_layout, n_actors);
+
+  g_free (carousel_actors);
+  carousel_actors = g_new0 (ClutterActor*, n_actors);
+  n_carousel_actors_allocated = n_actors;
+}
+
+/* Add positions to the end of the layout, keeping the actors that it has.
+ * The array grows geometrically, like the layout's own arrays,
+ * so that adding a few at a time doesn't copy it each time:
+ */
+void grow_carousel_layout(guint n_actors)
+{
+  if(!carousel_layout)
+    create_carousel_layout (0);
+
+  const guint old_n_actors = carousel_layout_get_n_items (carousel_layout);
+  g_return_if_fail (n_actors >= old_n_actors);
+
+  carousel_layout_set_n_items (carousel_layout, n_actors);
+
+  if(n_actors > n_carousel_actors_allocated)
+  {
+    n_carousel_actors_allocated = MAX (n_actors, n_carousel_actors_allocated * 2);
+    carousel_actors = g_renew (ClutterActor*, carousel_actors, n_carousel_actors_allocated);
+  }
+
+  memset (carousel_actors + old_n_actors, 0, (n_actors - old_n_actors) * sizeof (ClutterActor*));
+}
+
+/* Add the item's actor to the stage: */
+void add_item_actor(Item *item)
+{
+  ClutterActor *actor = item->actor;
+  clutter_container_add_actor (CLUTTER_CONTAINER (carousel_group), actor);
+
+  /* Allow the actor to emit events.
+   * By default only the stage does this.
+   */
+  clutter_actor_set_reactive (actor, TRUE);
+
+  /* Connect signal handlers for events: */
+  g_signal_connect (actor, "button-press-event",
+    G_CALLBACK (on_texture_button_press), item);
+
+  clutter_actor_show (actor);
+}
+
+/* Move n_actors actors, from first, to their places on the ellipse, except for
+ * the item at the front when the rotation has finished, because that has been moved up:
+ */
+void apply_carousel_layout_range(guint first, guint n_actors)
+{
+  ClutterActor *front_actor = NULL;
+  guint front_actor_index = 0;
+
+  if(item_at_front && item_at_front->actor && !clutter_timeline_is_playing (timeline_rotation))
+  {
+    guint i = 0;
+    for (i = first; i < first + n_actors; ++i)
+    {
+      if(carousel_actors[i] == item_at_front->actor)
+      {
+        front_actor = carousel_actors[i];
+        front_actor_index = i;
+        carousel_actors[i] = NULL;
+        break;
+      }
+    }
+  }
+
+  carousel_layout_apply_range (carousel_layout, carousel_actors, first, n_actors);
+
+  if(front_actor)
+    carousel_actors[front_actor_index] = front_actor;
+}
+
+/* Move all the actors to their places on the ellipse: */
+void apply_carousel_layout()
+{
+  apply_carousel_layout_range (0, carousel_layout_get_n_items (carousel_layout));
+}
+
+/* Show this item in this slot instead of the slot's previous item: */
+void bind_slot(Slot *slot, Item *item, gint priority)
+{
+  if(slot->item == item)
+    return;
+
+  if(slot->item)
+  {
+    release_item_texture (slot->item);
+    cancel_item_upload (slot->item);
+    slot->item->actor = NULL;
+    slot->item->tier = ITEM_TIER_NONE;
+    slot->item->evicted = FALSE;
+  }
+
+  slot->item = item;
+  item->actor = slot->actor;
+  item->tier = ITEM_TIER_NONE;
+  example_atlas_image_set_region (EXAMPLE_ATLAS_IMAGE (slot->actor), NULL);
+
+  if(item->has_thumbnail)
+    set_item_tier (item, ITEM_TIER_THUMBNAIL);
+  else
+    request_item_thumbnail (item, priority);
+}
+
+/* Put the items around virtual_front in the slots, and position the slots.
+ * Each item always uses the same slot, so only the slot at the back
+ * gets a new item as the ellipse rotates by one item.
+ */
+void layout_virtual_carousel()
+{
+  if(!n_slots)
+    return;
+
+  const gint base = (gint)floor (virtual_front);
+  guint k = 0;
+  for (k = 0; k < n_slots; ++k)
+  {
+    const gint offset = (gint)k - ((gint)n_slots - 1) / 2;
+    const gint position = base + offset;
+
+    const guint slot_index = positive_modulo (position, n_slots);
+    bind_slot (&slots[slot_index], get_item (positive_modulo (position, items->len)), ABS (offset));
+
+    carousel_layout_set_angle (carousel_layout, slot_index,
+      180 + angle_step * (position - virtual_front));
+  }
+
+  carousel_layout_update (carousel_layout, 0);
+  apply_carousel_layout ();
+}
+
+static gboolean
+on_slot_button_press (ClutterActor *actor, ClutterEvent *event, gpointer user_data)
+{
+  Slot *slot = (Slot*)user_data;
+  if(!slot->item)
+    return FALSE;
+
+  return on_texture_button_press (actor, event, slot->item);
+}
+
+void add_slot_actors()
+{
+  n_slots = MIN ((guint)(360 / angle_step), items->len);
+  slots = g_new0 (Slot, n_slots);
+  create_carousel_layout (n_slots);
+
+  guint i = 0;
+  for (i = 0; i < n_slots; ++i)
+  {
+    Slot *slot = &slots[i];
+    slot->actor = example_atlas_image_new ();
+    carousel_actors[i] = slot->actor;
+    clutter_container_add_actor (CLUTTER_CONTAINER (carousel_group), slot->actor);
+    clutter_actor_set_reactive (slot->actor, TRUE);
+    g_signal_connect (slot->actor, "button-press-event",
+      G_CALLBACK (on_slot_button_press), slot);
+    clutter_actor_show (slot->actor);
+  }
+
+  layout_virtual_carousel ();
+}
+
+void clear_slots()
+{
+  guint i = 0;
+  for (i = 0; i < n_slots; ++i)
+  {
+    if(slots[i].item)
+    {
+      release_item_texture (slots[i].item);
+      slots[i].item->actor = NULL;
+      slots[i].item->tier = ITEM_TIER_NONE;
+    }
+
+    clutter_actor_destroy (slots[i].actor);
+  }
+
+  g_free (slots);
+  slots = NULL;
+  n_slots = 0;
+}
+
+gdouble angle_in_360(gdouble angle)
+{
+  gdouble result = fmod (angle, 360);
+  if(result < 0)
+    result += 360;
+  
+  return result;
+}
+
+/* The value of the current rotation, and its speed per second, at this time: */
+void get_motion_value(gdouble *value, gdouble *velocity)
+{
+  gdouble s = 1;
+  if(motion_duration > 0 && clutter_timeline_is_playing (timeline_rotation))
+    s = MIN (g_timer_elapsed (motion_timer, NULL) / motion_duration, 1);
+
+  /* A cubic Hermite curve, with the start speed at the start, and no speed at the end: */
+  const gdouble s2 = s * s;
+  const gdouble s3 = s2 * s;
+  const gdouble start_slope = motion_velocity * motion_duration;
+  if(value)
+    *value = (2 * s3 - 3 * s2 + 1) * motion_from +
+      (s3 - 2 * s2 + s) * start_slope + (3 * s2 - 2 * s3) * motion_to;
+
+  if(velocity)
+  {
+    *velocity = 0;
+    if(s < 1)
+      *velocity = ((6 * s2 - 6 * s) * motion_from +
+        (3 * s2 - 4 * s + 1) * start_slope + (6 * s - 6 * s2) * motion_to) / motion_duration;
+  }
+}
+
+/* Move the rotation's value from, to, in about this many seconds.
+ * If it is already rotating, it keeps its current speed, and the timeline
+ * keeps running, so the next frame already moves towards the new target.
+ */
+void start_motion(gdouble from, gdouble to, gdouble duration)
+{
+  const gdouble distance = to - from;
+
+  gdouble velocity = 0;
+  if(clutter_timeline_is_playing (timeline_rotation))
+    get_motion_value (NULL, &velocity);
+  else if(duration > 0)
+    velocity = G_PI / 2 * distance / duration; /* Like an ease-out sine curve. */
+
+  /* The curve would go past the target if it started too fast for the distance: */
+  if(velocity * distance > 0 && fabs (velocity) * duration > 3 * fabs (distance))
+    duration = 3 * fabs (distance) / fabs (velocity);
+
+  motion_from = from;
+  motion_to = to;
+  motion_velocity = velocity;
+  motion_duration = duration;
+  g_timer_start (motion_timer);
+
+  if(!clutter_timeline_is_playing (timeline_rotation))
+    clutter_timeline_start (timeline_rotation);
+}
+
+/* Rotate to another item, near or far, or stop when we have done enough: */
+static gboolean
+on_benchmark_idle_next_rotation (gpointer data G_GNUC_UNUSED)
+{
+  ++benchmark_rotation;
+  if(benchmark_rotation >= benchmark_n_rotations || !item_at_front || items->len < 2)
+  {
+    clutter_main_quit ();
+    return FALSE;
+  }
+
+  const guint step = 1 + (benchmark_rotation * 7) % (items->len - 1);
+  benchmark_frame_started = FALSE;
+  rotate_all_until_item_is_at_front (get_item ((item_at_front->index + step) % items->len));
+
+  return FALSE; /* Don't call this again. */
+}
+
+/* This signal handler is called when the item has finished 
+ * moving up and increasing in size.
+ */
+void on_timeline_moveup_completed(ClutterTimeline* timeline G_GNUC_UNUSED, gpointer user_data G_GNUC_UNUSED)
+{
+  if(benchmark)
+    clutter_threads_add_idle (on_benchmark_idle_next_rotation, NULL);
+}
+
+/* Whether any of the item is on the stage, at this position and depth,
+ * and it was not hidden behind other items when the carousel was last painted:
+ */
+gboolean get_item_is_in_view(Item *item, gfloat x, gfloat depth)
+{
+  if(!item->actor)
+    return FALSE;
+
+  if(example_carousel_group_get_child_culled (EXAMPLE_CAROUSEL_GROUP (carousel_group), item->actor))
+    return FALSE;
+
+  /* The stage's perspective scales things around the middle of the stage: */
+  const gfloat stage_width = clutter_actor_get_width (stage);
+  const gfloat scale = viewpoint_distance / MAX(viewpoint_distance - depth, 1);
+  const gfloat half_width = clutter_actor_get_width (item->actor) / 2;
+  const gfloat center_x = stage_width / 2 + (x + half_width - stage_width / 2) * scale;
+  return center_x + half_width * scale >= 0 && center_x - half_width * scale <= stage_width;
+}
+
+/* Choose the item's texture for this frame, with the position that it has now.
+ */
+void update_item_texture(Item *item, gfloat x, gfloat depth)
+{
+  if(!item)
+    return;
+
+  const gboolean visible = item == item_at_front || get_item_is_in_view (item, x, depth);
+  if(visible)
+  {
+    item->visible_frame = frame_counter;
+    touch_item_texture (item);
+  }
+
+  /* Keep showing the placeholder until the item comes back into view: */
+  if(item->evicted && !visible)
+    return;
+
+  set_item_tier (item, choose_tier (item, depth));
+
+  /* Decode it again if the thumbnail cache does not have it: */
+  if(item->evicted && item->tier == ITEM_TIER_NONE && !item->upload_pending)
+  {
+    item->has_thumbnail = FALSE;
+    request_item_thumbnail (item, 0);
+  }
+}
+
+/* This signal handler is called for each frame while the items are rotating
+ * around the ellipse, so we can use smaller textures for the items that are
+ * further away.
+ */
+void update_rotation_frame()
+{
+  gdouble value = 0;
+  get_motion_value (&value, NULL);
+  update_viewpoint_distance ();
+
+  if(virtual_mode)
+  {
+    virtual_front = value;
+    layout_virtual_carousel ();
+
+    ++frame_counter;
+    guint i = 0;
+    for (i = 0; i < n_slots; ++i)
+    {
+      gfloat x = 0;
+      gfloat depth = 0;
+      carousel_layout_get_position (carousel_layout, i, &x, NULL, &depth);
+      update_item_texture (slots[i].item, x, depth);
+    }
+
+    enforce_texture_budget ();
+    return;
+  }
+
+  carousel_layout_update (carousel_layout, value);
+  carousel_layout_apply (carousel_layout, carousel_actors);
+
+  ++frame_counter;
+  guint i = 0;
+  for (i = 0; i < items->len; ++i)
+  {
+    gfloat x = 0;
+    gfloat depth = 0;
+    carousel_layout_get_position (carousel_layout, i, &x, NULL, &depth);
+    update_item_texture (get_item (i), x, depth);
+  }
+
+  enforce_texture_budget ();
+}
+
+/* This is called when the items have completely 
+ * rotated around the ellipse.
+ */
+void on_timeline_rotation_completed(ClutterTimeline* timeline G_GNUC_UNUSED, gpointer user_data G_GNUC_UNUSED)
+{
+  /* All the items have now been rotated so that the clicked item is at the
+   * front.  Now we transform just this one item gradually some more, and
+   * show the filename.
+   */
+  if(virtual_mode)
+  {
+    virtual_front = motion_to;
+    layout_virtual_carousel ();
+  }
+
+  /* Show the front image at its full resolution, because it will be bigger.
+   * It has usually been decoded while rotating, but until then we show the
+   * thumbnail:
+   */
+  set_item_tier (item_at_front, ITEM_TIER_THUMBNAIL);
+  GdkPixbuf *full_image = (GdkPixbuf*)g_hash_table_lookup (full_images, get_item_filepath (item_at_front));
+  if(full_image)
+    show_full_image (item_at_front, full_image);
+
+  /* Transform the image: */
+  ClutterActor *actor = item_at_front->actor;
+
+  /* The behaviours stay applied to the last item that was moved up,
+   * so we only need to move them when it is a different item:
+   */
+  if(!clutter_behaviour_is_applied (behaviour_scale, actor))
+  {
+    clutter_behaviour_remove_all (behaviour_scale);
+    clutter_behaviour_remove_all (behaviour_path);
+    clutter_behaviour_apply (behaviour_scale, actor);
+    clutter_behaviour_apply (behaviour_path, actor);
+  }
+ 
+  /* Scale the item from its normal scale to approximately twice the normal scale: */
+  gdouble scale_start = 0;
+  clutter_actor_get_scale (actor, &scale_start, NULL);
+  const gdouble scale_end = scale_start * 1.8;
+  clutter_behaviour_scale_set_bounds (CLUTTER_BEHAVIOUR_SCALE (behaviour_scale),
+    scale_start, scale_start, scale_end, scale_end);
+
+  /* Move the item up the y axis, by replacing the path's two nodes: */
+  ClutterPath *path = clutter_behaviour_path_get_path (CLUTTER_BEHAVIOUR_PATH (behaviour_path));
+  ClutterPathNode node;
+  node.type = CLUTTER_PATH_MOVE_TO;
+  node.points[0].x = clutter_actor_get_x (actor);
+  node.points[0].y = clutter_actor_get_y (actor);
+  clutter_path_replace_node (path, 0, &node);
+  node.type = CLUTTER_PATH_LINE_TO;
+  node.points[0].y -= 250;
+  clutter_path_replace_node (path, 1, &node);
+
+  /* Show the filename gradually: */
+  clutter_text_set_text (CLUTTER_TEXT (label_filename), get_item_filepath (item_at_front));
+
+  clutter_timeline_rewind (timeline_moveup);
+  clutter_timeline_start (timeline_moveup);
+}
+
+/* Move the items for this frame, and finish the rotation when they have arrived: */
+void on_timeline_rotation_new_frame(ClutterTimeline* timeline G_GNUC_UNUSED, gint elapsed_msecs G_GNUC_UNUSED, gpointer user_data G_GNUC_UNUSED)
+{
+  if(!benchmark)
+    update_rotation_frame ();
+  else
+  {
+    /* Measure the time since the last frame of this rotation: */
+    if(benchmark_frame_started)
+      benchmark_end_sample (benchmark, BENCHMARK_SAMPLE_FRAME_INTERVAL);
+    benchmark_begin_sample (benchmark, BENCHMARK_SAMPLE_FRAME_INTERVAL);
+    benchmark_frame_started = TRUE;
+
+    benchmark_begin_sample (benchmark, BENCHMARK_SAMPLE_LAYOUT);
+    update_rotation_frame ();
+    benchmark_end_sample (benchmark, BENCHMARK_SAMPLE_LAYOUT);
+  }
+
+  /* Stop when the items have arrived: */
+  if(g_timer_elapsed (motion_timer, NULL) >= motion_duration)
+  {
+    clutter_timeline_stop (timeline_rotation);
+    on_timeline_rotation_completed (timeline_rotation, NULL);
+  }
+}
+
+/* Create the timeline and behaviours for moving the front item up,
+ * without any actors yet:
+ */
+void create_moveup_animation()
+{
+  timeline_moveup = clutter_timeline_new(1000 /* milliseconds */);
+  alpha_moveup = clutter_alpha_new_full (timeline_moveup, CLUTTER_EASE_OUT_SINE);
+  g_object_ref_sink (alpha_moveup);
+
+  behaviour_scale = clutter_behaviour_scale_new (alpha_moveup, 1, 1, 1, 1);
+
+  /* The path always has a start and an end node, which are replaced for each item: */
+  ClutterPath *path = clutter_path_new ();
+  clutter_path_add_move_to (path, 0, 0);
+  clutter_path_add_line_to (path, 0, 0);
+  behaviour_path = clutter_behaviour_path_new (alpha_moveup, path);
+
+  /* The label only ever fades in: */
+  behaviour_opacity = clutter_behaviour_opacity_new (alpha_moveup, 0, 255);
+  clutter_behaviour_apply (behaviour_opacity, label_filename);
+
+  g_signal_connect (timeline_moveup, "completed", G_CALLBACK (on_timeline_moveup_completed), NULL);
+}
+
+void free_moveup_animation()
+{
+  clutter_timeline_stop (timeline_moveup);
+
+  g_object_unref (behaviour_scale);
+  g_object_unref (behaviour_path);
+  g_object_unref (behaviour_opacity);
+  g_object_unref (alpha_moveup);
+  g_object_unref (timeline_moveup);
+}
+
+/* In the virtual mode, the items keep their order instead of wrapping around
+ * the ellipse, so we rotate the shortest way to the item, in either direction.
+ */
+void rotate_virtual_until_item_is_at_front(Item *item)
+{
+  const gint count = items->len;
+  const gint front = (gint)floor (virtual_front + 0.5);
+  gint distance = positive_modulo (item->index - front, count);
+  if(distance > count / 2)
+    distance -= count;
+
+  const gdouble front_end = front + distance;
+
+  /* Reset the sizes: */
+  guint i = 0;
+  for (i = 0; i < n_slots; ++i)
+    scale_texture_default (slots[i].actor);
+
+  item_at_front = item;
+
+  /* Keep the same speed as in the normal mode: */
+  const gdouble angle_diff = fabs (front_end - virtual_front) * angle_step;
+  if(angle_diff < 1 && !clutter_timeline_is_playing (timeline_rotation))
+  {
+    virtual_front = front_end;
+    motion_to = front_end;
+    layout_virtual_carousel ();
+    on_timeline_rotation_completed (timeline_rotation, NULL);
+    return;
+  }
+
+  start_motion (virtual_front, front_end, angle_diff * 0.2 / 1000);
+}
+
+/* Start the rotation with the first item at angle_start, and return how far
+ * the items must rotate to bring this item to the front. All the items
+ * rotate by the same angle, so this takes the same time however many
+ * items there are.
+ */
+gdouble aim_carousel_at_item(Item *item, gdouble angle_start)
+{
+  /* Reset the size of the item that was moved up, which is the only one
+   * that is not at its normal size:
+   */
+  if(item_at_front && item_at_front->actor)
+    scale_texture_default (item_at_front->actor);
+
+  rotation_start_angle = angle_in_360 (angle_start);
+  carousel_layout_set_offset (carousel_layout, rotation_start_angle);
+
+  /* Move 360 instead of 0
+   * when moving for the first time,
+   * and when clicking on something that is already at the front.
+   */
+  const gdouble angle_item = angle_in_360 (rotation_start_angle + angle_step * item->index);
+  gdouble angle_end = 180;
+  if(item_at_front == item)
+    angle_end += 360;
+
+  if(angle_item < angle_end)
+    return angle_end - angle_item;
+  else
+    return 360 - (angle_item - angle_end);
+}
+
+void rotate_all_until_item_is_at_front(Item *item)
+{
+  g_return_if_fail (item);
+
+  /* It is already rotating to this item: */
+  if(item == item_at_front && clutter_timeline_is_playing (timeline_rotation))
+    return;
+
+  /* Stop the other timeline in case that is active at the same time: */
+  clutter_timeline_stop (timeline_moveup);
+
+  clutter_actor_set_opacity (label_filename, 0);
+
+  /* Start decoding the sharp version now, so it is ready when the item is moved up: */
+  prefetch_full_image_of_front (item);
+
+  if(virtual_mode)
+  {
+    rotate_virtual_until_item_is_at_front (item);
+    return;
+  }
+
+  /* Get the item's position in the array: */
+  const gint pos = item->index;
+  g_assert (get_item (pos) == item);
+
+  if(!item_at_front && items->len)
+    item_at_front = get_item (0);
+
+  gint pos_front = 0;
+  if(item_at_front)
+     pos_front = item_at_front->index;
+
+  /* Calculate the start angle of the first item: */
+  gdouble angle_start = 0;
+  if(clutter_timeline_is_playing (timeline_rotation))
+  {
+    /* Continue from where the items are now: */
+    gdouble value = 0;
+    get_motion_value (&value, NULL);
+    angle_start = rotation_start_angle + value;
+  }
+  else
+    angle_start = 180 - (angle_step * pos_front);
+
+  const gdouble angle_diff = aim_carousel_at_item (item, angle_start);
+
+  /* Remember what item will be at the front when this rotation finishes: */
+  item_at_front = item;
+
+  start_motion (0, angle_diff, angle_diff * 0.2 / 1000);
+}
+
+/* Remove the item, keeping the others in the same order: */
+void remove_item(Item *item)
+{
+  const guint index = item->index;
+
+  if(item == item_at_front)
+  {
+    /* Stop moving it up, and let the next item be at the front instead: */
+    if(clutter_timeline_is_playing (timeline_moveup))
+    {
+      clutter_timeline_stop (timeline_moveup);
+      on_timeline_moveup_completed (timeline_moveup, NULL);
+    }
+    clutter_actor_set_opacity (label_filename, 0);
+
+    item_at_front = NULL;
+    if(index + 1 < items->len)
+      item_at_front = get_item (index + 1);
+    else if(index > 0)
+      item_at_front = get_item (index - 1);
+  }
+
+  /* Forget the slot that shows it, if any: */
+  guint i = 0;
+  for (i = 0; i < n_slots; ++i)
+  {
+    if(slots[i].item == item)
+      slots[i].item = NULL;
+  }
+
+  g_hash_table_remove (items_by_path, &item->path);
+  g_ptr_array_remove_index (items, index);
+  on_foreach_clear_items (item, NULL);
+
+  for (i = index; i < items->len; ++i)
+    get_item (i)->index = i;
+}
+
+/* Decode the item's file again, showing the old image until that is done: */
+void reload_item(Item *item)
+{
+  item->has_thumbnail = FALSE;
+  item->thumbnail_requested = FALSE;
+
+  /* In the virtual mode, it is decoded again when it is next put in a slot: */
+  if(item->actor)
+    request_item_thumbnail (item, 0);
+
+  /* Decode the full-size image again too, if we had it: */
+  if(g_hash_table_remove (full_images, get_item_filepath (item)))
+    prefetch_full_image (item, item == item_at_front ? -2 : -1);
+}
+
+/* Add, remove or reload the item for this file, depending on what happened to it: */
+void apply_file_change(const gchar *path)
+{
+  Item *item = get_item_by_path (path);
+
+  if(item)
+  {
+    if(image_sniffer_check_file (path, NULL) == IMAGE_SNIFF_OK)
+      reload_item (item);
+    else
+      remove_item (item);
+
+    return;
+  }
+
+  item = add_item (path, NULL, NULL);
+  if(item && !virtual_mode)
+  {
+    add_item_actor (item);
+    request_item_thumbnail (item, 0);
+  }
+}
+
+/* Put the items back on the ellipse after some were added or removed,
+ * keeping the item at the front where it was, even while rotating:
+ */
+void update_layout_after_changes(gint old_front_index)
+{
+  const gint front_index = item_at_front ? (gint)item_at_front->index : 0;
+  const gint moved = front_index - old_front_index;
+
+  if(virtual_mode)
+  {
+    virtual_front += moved;
+    motion_from += moved;
+    motion_to += moved;
+
+    if(n_slots != MIN ((guint)(360 / angle_step), items->len))
+    {
+      clear_slots ();
+      add_slot_actors ();
+    }
+    else
+      layout_virtual_carousel ();
+
+    return;
+  }
 
-/* The y position of the ellipse of images: */
-const gint ELLIPSE_Y = 390;
-const gint ELLIPSE_HEIGHT = 450; /* The distance from front to back when it's rotated 90 degrees. */
-const gint IMAGE_HEIGHT = 100;
+  rotation_start_angle -= angle_step * moved;
 
-static gboolean
-on_texture_button_press (ClutterActor *actor, ClutterEvent *event, gpointer data);
+  create_carousel_layout (items->len);
+  carousel_layout_set_offset (carousel_layout, rotation_start_angle);
 
-const double angle_step = 30;
+  guint i = 0;
+  for (i = 0; i < items->len; ++i)
+  {
+    carousel_layout_set_angle (carousel_layout, i, angle_step * i);
+    carousel_actors[i] = get_item (i)->actor;
+  }
 
-typedef struct Item
+  gdouble value = 0;
+  get_motion_value (&value, NULL);
+  carousel_layout_update (carousel_layout, value);
+  apply_carousel_layout ();
+}
+
+/* Add an item for this file, if it is an image that we don't have yet.
+ * The directory watcher might have added it already.
+ * found is as for add_item().
+ */
+void add_found_file(const gchar *path, const DirScannerFile *found)
 {
-  ClutterActor *actor;
-  ClutterBehaviour *ellipse_behaviour;
-  gchar* filepath;
+  if(get_item_by_path (path))
+    return;
+
+  ImageSniffResult result = IMAGE_SNIFF_OK;
+  Item *item = add_item (path, found, &result);
+  if(!item)
+  {
+    ++n_skipped_files[result];
+    ++n_skipped_files_total;
+    return;
+  }
+
+  /* In the virtual mode, it is decoded when it is put in a slot: */
+  if(!virtual_mode)
+  {
+    add_item_actor (item);
+    request_item_thumbnail (item, get_load_priority (item->index, items->len));
+  }
 }
-Item;
 
-Item* item_at_front = NULL;
+/* Put the items from first_index onwards on the ellipse, after the ones that
+ * are already there, without moving those again, so that adding some items
+ * takes only as long as the new items need, however many there are already:
+ */
+void append_to_carousel_layout(guint first_index)
+{
+  grow_carousel_layout (items->len);
+
+  guint i = 0;
+  for (i = first_index; i < items->len; ++i)
+  {
+    carousel_layout_set_angle (carousel_layout, i, angle_step * i);
+    carousel_actors[i] = get_item (i)->actor;
+  }
 
-GSList *list_items = 0;
+  gdouble value = 0;
+  get_motion_value (&value, NULL);
+  carousel_layout_update_range (carousel_layout, value, first_index, items->len - first_index);
+  apply_carousel_layout_range (first_index, items->len - first_index);
+}
 
-void on_foreach_clear_list_items(gpointer data, gpointer user_data G_GNUC_UNUSED)
+/* Put the items that add_found_file() has added on the ellipse,
+ * all at once, after the ones that were already there:
+ */
+void show_found_files(gint old_front_index)
 {
-  Item* item = (Item*)data;
+  const gboolean first_items = !item_at_front && items->len;
+  if(first_items)
+    item_at_front = get_item (0);
+
+  enforce_texture_budget ();
 
-  /* We don't need to unref the actor because the floating reference was taken by the stage. */
-  g_object_unref (item->ellipse_behaviour);
-  g_free (item->filepath);
-  g_free (item);
+  /* Only the new items need to be laid out, unless the directory watcher
+   * has removed some, or moved the front item, in the meantime:
+   */
+  const guint n_laid_out = carousel_layout ? carousel_layout_get_n_items (carousel_layout) : 0;
+  const gint front_index = item_at_front ? (gint)item_at_front->index : 0;
+  if(!virtual_mode && n_laid_out <= items->len && front_index == old_front_index)
+    append_to_carousel_layout (n_laid_out);
+  else
+    update_layout_after_changes (old_front_index);
+
+  /* Move them a bit to start with.
+   * The benchmark does that when all the items are there.
+   */
+  if(first_items && !benchmark)
+    rotate_all_until_item_is_at_front (item_at_front);
 }
 
-void scale_texture_default(ClutterActor *texture)
+/* This is called when all the files have been found: */
+void finish_adding_files()
 {
-  int pixbuf_height = 0;
-  clutter_texture_get_base_size (CLUTTER_TEXTURE (texture), NULL, &pixbuf_height);
+  print_skipped_files (scan_directory_path);
 
-  const gdouble scale = pixbuf_height ? IMAGE_HEIGHT /  (gdouble)pixbuf_height : 0;
-  clutter_actor_set_scale (texture, scale, scale);
+  if(!benchmark)
+    return;
+
+  benchmark_mark (benchmark, "load_ms");
+
+  /* Start the benchmark's rotations, after the first one to the front item: */
+  if(item_at_front)
+    rotate_all_until_item_is_at_front (item_at_front);
+  else
+    clutter_threads_add_idle (on_benchmark_idle_next_rotation, NULL);
 }
 
-void load_images(const gchar* directory_path)
+/* This is called in the main loop with the images that the scanner has found
+ * since it was last called, so we can lay out the new items all at once:
+ */
+void on_dir_scanner_files(const DirScannerFile *files, guint n_files, gpointer user_data G_GNUC_UNUSED)
 {
-  g_return_if_fail(directory_path);
+  const gint old_front_index = item_at_front ? (gint)item_at_front->index : 0;
 
-  /* Clear any existing images: */
-  g_slist_foreach (list_items, on_foreach_clear_list_items, NULL);
-  g_slist_free (list_items);
+  guint i = 0;
+  for (i = 0; i < n_files; ++i)
+    add_found_file (files[i].path, &files[i]);
 
-  /* Create a new list: */
-  list_items = NULL;
-  
-  /* Discover the images in the directory: */
-  GError *error = NULL;
-  GDir* dir = g_dir_open (directory_path, 0, &error);
-  if(error)
-  {
-    g_warning("g_dir_open() failed: %s\n", error->message);
-    g_clear_error(&error);
-    return;
-  }
+  show_found_files (old_front_index);
+}
 
-  const gchar* filename = NULL;
-  while ( (filename = g_dir_read_name(dir)) )
+/* This is called in the main loop when the scanner has found all the files: */
+void on_dir_scanner_done(DirScanner *scanner, gpointer user_data G_GNUC_UNUSED)
+{
+  guint64 n_entries = 0;
+  guint n_directories = 0;
+  guint n_steals = 0;
+  gdouble seconds = 0;
+  dir_scanner_get_stats (scanner, &n_entries, &n_directories, &n_steals, &seconds);
+  scan_entries_per_second = seconds > 0 ? n_entries / seconds : 0;
+
+  g_print ("Scanned %" G_GUINT64_FORMAT " entries in %u directories in %.3f seconds "
+    "(%.0f entries per second), with %u directories stolen by idle threads\n",
+    n_entries, n_directories, seconds, scan_entries_per_second, n_steals);
+
+  /* The scanner skipped the files that are not images: */
+  guint n_skipped[IMAGE_SNIFF_N_RESULTS] = { 0 };
+  dir_scanner_get_skipped_files (scanner, n_skipped);
+  guint i = 0;
+  for (i = 0; i < IMAGE_SNIFF_N_RESULTS; ++i)
   {
-    gchar* path = g_build_filename (directory_path, filename, NULL);
-
-    /* Try to load the file as an image: */
-    ClutterActor *actor = clutter_texture_new_from_file (path, NULL);
-    if(actor)
-    {
-      Item* item = g_new0(Item, 1);
+    n_skipped_files[i] += n_skipped[i];
+    n_skipped_files_total += n_skipped[i];
+  }
 
-      item->actor = actor;
-      item->filepath = g_strdup(path);
+  dir_scanner_free (scanner);
+  dir_scanner = NULL;
 
-      /* Make sure that all images are shown with the same height: */
-      scale_texture_default (item->actor);
+  finish_adding_files ();
+}
 
-      list_items = g_slist_append (list_items, item);
-    }
+static gboolean
+on_pending_changes_timeout (gpointer data G_GNUC_UNUSED)
+{
+  const gint old_front_index = item_at_front ? (gint)item_at_front->index : 0;
 
+  GHashTableIter iter;
+  gpointer key = NULL;
+  g_hash_table_iter_init (&iter, pending_changes);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+  {
+    gchar *path = g_build_filename (images_directory, (const gchar*)key, NULL);
+    apply_file_change (path);
     g_free (path);
   }
-}
 
+  g_hash_table_remove_all (pending_changes);
+  pending_changes_source = 0;
 
-void add_to_ellipse_behaviour(ClutterTimeline *timeline_rotation, gdouble start_angle, Item *item)
-{
-  g_return_if_fail (timeline_rotation);
+  if(!item_at_front && items->len)
+    item_at_front = get_item (0);
 
-  ClutterAlpha *alpha = clutter_alpha_new_full (timeline_rotation, CLUTTER_EASE_OUT_SINE);
- 
-  item->ellipse_behaviour = clutter_behaviour_ellipse_new (alpha, 
-    320, ELLIPSE_Y, /* x, y */
-    ELLIPSE_HEIGHT, ELLIPSE_HEIGHT, /* width, height */
-    CLUTTER_ROTATE_CW,
-    start_angle, start_angle + 360);
-  clutter_behaviour_ellipse_set_angle_tilt (CLUTTER_BEHAVIOUR_ELLIPSE (item->ellipse_behaviour), 
-    CLUTTER_X_AXIS, -90);
-  /* Note that ClutterAlpha has a floating reference, so we don't need to unref it. */
+  update_layout_after_changes (old_front_index);
 
-  clutter_behaviour_apply (item->ellipse_behaviour, item->actor);
+  return FALSE; /* Don't call this again. */
 }
 
-void add_image_actors()
+/* This is called without the clutter lock held, so we just remember the file,
+ * and handle it later in on_pending_changes_timeout(). A file that is being
+ * written gets several events, but is then only loaded once.
+ */
+static void
+on_directory_changed (GFileMonitor *monitor G_GNUC_UNUSED, GFile *file,
+  GFile *other_file G_GNUC_UNUSED, GFileMonitorEvent event_type, gpointer user_data G_GNUC_UNUSED)
 {
-  int x = 20;
-  int y = 0;
-  gdouble angle = 0;
-  GSList *list = list_items;
-  while (list)
+  switch (event_type)
   {
-    /* Add the actor to the stage: */
-    Item *item = (Item*)list->data;
-    ClutterActor *actor = item->actor;
-    clutter_container_add_actor (CLUTTER_CONTAINER (stage), actor);
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_CHANGED:
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_DELETED:
+      break;
+    default:
+      return;
+  }
 
-    /* Set an initial position: */
-    clutter_actor_set_position (actor, x, y);
-    y += 100;
+  g_hash_table_insert (pending_changes, g_file_get_basename (file), NULL);
 
-    /* Allow the actor to emit events.
-     * By default only the stage does this.
-     */
-    clutter_actor_set_reactive (actor, TRUE);
+  if(!pending_changes_source)
+    pending_changes_source = clutter_threads_add_timeout (PENDING_CHANGES_DELAY,
+      on_pending_changes_timeout, NULL);
+}
 
-    /* Connect signal handlers for events: */
-    g_signal_connect (actor, "button-press-event",
-      G_CALLBACK (on_texture_button_press), item);
+void watch_images_directory(const gchar *directory_path)
+{
+  if(directory_monitor)
+    g_object_unref (directory_monitor);
 
-    add_to_ellipse_behaviour (timeline_rotation, angle, item);
-    angle += angle_step;
+  g_free (images_directory);
+  images_directory = g_strdup (directory_path);
 
-    clutter_actor_show (actor);
+  if(!pending_changes)
+    pending_changes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
-    list = g_slist_next (list);
+  GError *error = NULL;
+  GFile *directory = g_file_new_for_path (directory_path);
+  directory_monitor = g_file_monitor_directory (directory, G_FILE_MONITOR_NONE, NULL, &error);
+  g_object_unref (directory);
+  if(error)
+  {
+    g_warning ("g_file_monitor_directory() failed: %s\n", error->message);
+    g_clear_error (&error);
+    return;
   }
+
+  g_signal_connect (directory_monitor, "changed", G_CALLBACK (on_directory_changed), NULL);
 }
 
-gdouble angle_in_360(gdouble angle)
+static gboolean
+on_texture_button_press (ClutterActor *actor G_GNUC_UNUSED, ClutterEvent *event G_GNUC_UNUSED, gpointer user_data G_GNUC_UNUSED)
 {
-  gdouble result = angle;
-  while(result >= 360)
-    result -= 360;
-  
-  return result;
+  /* This works while the items are rotating too, by changing the rotation's target: */
+  Item *item = (Item*)user_data;
+  rotate_all_until_item_is_at_front (item);
+
+  return TRUE;
 }
 
-/* This signal handler is called when the item has finished 
- * moving up and increasing in size.
- */
-void on_timeline_moveup_completed(ClutterTimeline* timeline G_GNUC_UNUSED, gpointer user_data G_GNUC_UNUSED)
+static gint
+compare_actor_depths (gconstpointer a, gconstpointer b)
 {
-  /* Unref this timeline because we have now finished with it: */
-  g_object_unref (timeline_moveup);
-  timeline_moveup = NULL;
-
-  g_object_unref (behaviour_scale);
-  behaviour_scale = NULL;
+  const gfloat depth_a = clutter_actor_get_depth (*(ClutterActor**)a);
+  const gfloat depth_b = clutter_actor_get_depth (*(ClutterActor**)b);
 
-  g_object_unref (behaviour_path);
-  behaviour_path = NULL;
+  if(depth_a == depth_b)
+    return 0;
 
-  g_object_unref (behaviour_opacity);
-  behaviour_opacity = NULL;
+  return depth_a < depth_b ? -1 : 1;
 }
 
-/* This signal handler is called when the items have completely 
- * rotated around the ellipse.
+/* The most full sorts that we time in one frame for group_sort_us.
+ * ClutterGroup would do one for every actor, which would take minutes
+ * for the biggest numbers of items, so we time this many and scale it up.
  */
-void on_timeline_rotation_completed(ClutterTimeline* timeline G_GNUC_UNUSED, gpointer user_data G_GNUC_UNUSED)
+#define MAX_TIMED_GROUP_SORTS 256
+
+/* Get how long it takes to sort the actors by depth for one frame, in
+ * microseconds, with the carousel group's insertion sort, with one full sort,
+ * and with the full sort that ClutterGroup does for every actor that moves,
+ * n_items times in each frame.
+ */
+void run_sort_benchmark(guint n_items, gint n_frames, gdouble *sort_us,
+  gdouble *one_full_sort_us, gdouble *group_sort_us)
 {
-  /* All the items have now been rotated so that the clicked item is at the
-   * front.  Now we transform just this one item gradually some more, and
-   * show the filename.
+  ClutterActor *group = example_carousel_group_new ();
+  g_object_ref_sink (group);
+
+  /* Spread the items evenly around the ellipse, like the virtual mode's items,
+   * so that few of them have the same depth:
    */
-  /* Transform the image: */
-  ClutterActor *actor = item_at_front->actor;
-  timeline_moveup = clutter_timeline_new(1000 /* milliseconds */);
-  ClutterAlpha *alpha =
-    clutter_alpha_new_full (timeline_moveup, CLUTTER_EASE_OUT_SINE);
- 
-  /* Scale the item from its normal scale to approximately twice the normal scale: */
-  gdouble scale_start = 0;
-  clutter_actor_get_scale (actor, &scale_start, NULL);
-  const gdouble scale_end = scale_start * 1.8;
+  GPtrArray *actors = g_ptr_array_sized_new (n_items);
+  guint i = 0;
+  for (i = 0; i < n_items; ++i)
+  {
+    carousel_layout_set_angle (carousel_layout, i, i * 360.0 / n_items);
+    carousel_actors[i] = clutter_rectangle_new ();
+    clutter_container_add_actor (CLUTTER_CONTAINER (group), carousel_actors[i]);
+    g_ptr_array_add (actors, carousel_actors[i]);
+  }
 
-  behaviour_scale = clutter_behaviour_scale_new (alpha,
-                                                 scale_start, scale_start,
-                                                 scale_end, scale_end);
-  clutter_behaviour_apply (behaviour_scale, actor);
-
-  /* Move the item up the y axis: */
-  ClutterKnot knots[2];
-  knots[0].x = clutter_actor_get_x (actor);
-  knots[0].y = clutter_actor_get_y (actor);
-  knots[1].x = knots[0].x;
-  knots[1].y = knots[0].y - 250;
-  behaviour_path =
-    clutter_behaviour_path_new_with_knots (alpha, knots, G_N_ELEMENTS(knots));
-  clutter_behaviour_apply (behaviour_path, actor);
+  /* Start from the sorted order of the first frame: */
+  carousel_layout_update (carousel_layout, 0);
+  carousel_layout_apply (carousel_layout, carousel_actors);
+  example_carousel_group_sort_depth_order (EXAMPLE_CAROUSEL_GROUP (group));
+  g_ptr_array_sort (actors, compare_actor_depths);
+
+  GTimer *timer = g_timer_new ();
+  gdouble sort_time = 0;
+  gdouble full_sort_time = 0;
+  gdouble group_sort_time = 0;
+  const guint n_group_sorts = MIN (n_items, MAX_TIMED_GROUP_SORTS);
+  gint frame = 0;
+  for (frame = 1; frame <= n_frames; ++frame)
+  {
+    carousel_layout_update (carousel_layout, frame * 0.36);
+    carousel_layout_apply (carousel_layout, carousel_actors);
 
-  /* Show the filename gradually: */
-  clutter_text_set_text (CLUTTER_TEXT (label_filename), item_at_front->filepath);
-  behaviour_opacity = clutter_behaviour_opacity_new (alpha, 0, 255);
-  clutter_behaviour_apply (behaviour_opacity, label_filename);
+    g_timer_start (timer);
+    example_carousel_group_sort_depth_order (EXAMPLE_CAROUSEL_GROUP (group));
+    sort_time += g_timer_elapsed (timer, NULL);
 
-  /* Start the timeline and handle its "completed" signal so we can unref it. */
-  g_signal_connect (timeline_moveup, "completed", G_CALLBACK (on_timeline_moveup_completed), NULL);
-  clutter_timeline_start (timeline_moveup);
+    g_timer_start (timer);
+    g_ptr_array_sort (actors, compare_actor_depths);
+    full_sort_time += g_timer_elapsed (timer, NULL);
+
+    /* These sort the order that is already sorted, as ClutterGroup's later
+     * sorts in a frame mostly do:
+     */
+    g_timer_start (timer);
+    for (i = 0; i < n_group_sorts; ++i)
+      g_ptr_array_sort (actors, compare_actor_depths);
+    group_sort_time += g_timer_elapsed (timer, NULL) * n_items / n_group_sorts;
+  }
 
-  /* Note that ClutterAlpha has a floating reference so we don't need to unref it. */
+  g_timer_destroy (timer);
+  g_ptr_array_free (actors, TRUE);
+
+  /* This destroys the actors too: */
+  clutter_actor_destroy (group);
+  g_object_unref (group);
+
+  *sort_us = sort_time * 1000000 / n_frames;
+  *one_full_sort_us = full_sort_time * 1000000 / n_frames;
+  *group_sort_us = group_sort_time * 1000000 / n_frames;
 }
 
-void rotate_all_until_item_is_at_front(Item *item)
+/* Print how long it takes to lay out different numbers of items for one frame,
+ * with and without SSE2, and to move and sort the actors, in microseconds:
+ */
+void run_layout_benchmark()
 {
-  g_return_if_fail (item);
+  const gint n_frames = 1000;
+  ClutterActor *actor = clutter_rectangle_new ();
+  g_object_ref_sink (actor);
 
-  clutter_timeline_stop(timeline_rotation);
+  /* The items that are clicked, which all share one actor: */
+  ClutterActor *item_actor = example_atlas_image_new ();
+  g_object_ref_sink (item_actor);
 
-  /* Stop the other timeline in case that is active at the same time: */
-  if(timeline_moveup)
-    clutter_timeline_stop (timeline_moveup);
+  g_print ("# items update_us update_scalar_us apply_us click_us sort_us one_full_sort_us group_sort_us\n");
 
-  clutter_actor_set_opacity (label_filename, 0);
+  guint n_items = 0;
+  for (n_items = 16; n_items <= 16384; n_items *= 4)
+  {
+    create_carousel_layout (n_items);
 
-  /* Get the item's position in the list: */
-  const gint pos = g_slist_index (list_items, item);
-  g_assert (pos != -1);
+    guint i = 0;
+    for (i = 0; i < n_items; ++i)
+    {
+      carousel_layout_set_angle (carousel_layout, i, i * angle_step);
+      carousel_actors[i] = actor;
+    }
 
-  if(!item_at_front && list_items)
-    item_at_front = (Item*)list_items->data;
+    GTimer *timer = g_timer_new ();
+    gint frame = 0;
+    for (frame = 0; frame < n_frames; ++frame)
+      carousel_layout_update (carousel_layout, frame * 0.36);
+    const gdouble update_time = g_timer_elapsed (timer, NULL);
 
-  gint pos_front = 0;
-  if(item_at_front)
-     pos_front = g_slist_index (list_items, item_at_front);
-  g_assert (pos_front != -1);
+    g_timer_start (timer);
+    for (frame = 0; frame < n_frames; ++frame)
+      carousel_layout_update_scalar (carousel_layout, frame * 0.36);
+    const gdouble update_scalar_time = g_timer_elapsed (timer, NULL);
 
-  /* const gint pos_offset_before_start = pos_front - pos; */ 
-  
-  /* Calculate the end angle of the first item: */
-  const gdouble angle_front = 180;
-  gdouble angle_start = angle_front - (angle_step * pos_front);
-  angle_start = angle_in_360 (angle_start);
-  gdouble angle_end = angle_front - (angle_step * pos);
+    /* Setting the properties costs the same for every actor,
+     * so one actor is enough, and we use fewer frames:
+     */
+    g_timer_start (timer);
+    for (frame = 0; frame < n_frames / 10; ++frame)
+      carousel_layout_apply (carousel_layout, carousel_actors);
+    const gdouble apply_time = g_timer_elapsed (timer, NULL) * 10;
+
+    /* What a click does before the rotation starts, for items all around the ellipse: */
+    Item *clicked_items = g_new0 (Item, n_items);
+    for (i = 0; i < n_items; ++i)
+    {
+      clicked_items[i].index = i;
+      clicked_items[i].actor = item_actor;
+    }
 
-  gdouble angle_diff = 0;
+    g_timer_start (timer);
+    for (frame = 0; frame < n_frames; ++frame)
+    {
+      Item *item = &clicked_items[(frame * 7919) % n_items];
+      aim_carousel_at_item (item, rotation_start_angle);
+      item_at_front = item;
+    }
+    const gdouble click_time = g_timer_elapsed (timer, NULL);
+
+    item_at_front = NULL;
+    g_free (clicked_items);
+    g_timer_destroy (timer);
+
+    gdouble sort_us = 0;
+    gdouble one_full_sort_us = 0;
+    gdouble group_sort_us = 0;
+    run_sort_benchmark (n_items, n_frames / 10, &sort_us, &one_full_sort_us, &group_sort_us);
+
+    g_print ("%u %.3f %.3f %.3f %.3f %.3f %.3f %.3f\n", n_items,
+      update_time * 1000000 / n_frames,
+      update_scalar_time * 1000000 / n_frames,
+      apply_time * 1000000 / n_frames,
+      click_time * 1000000 / n_frames,
+      sort_us, one_full_sort_us, group_sort_us);
+  }
 
-  /* Set the end angles: */
-  GSList *list = list_items;
-  while (list)
-  {
-    Item *this_item = (Item*)list->data;
+  g_object_unref (actor);
+  g_object_unref (item_actor);
+  carousel_layout_free (carousel_layout);
+  carousel_layout = NULL;
+  g_free (carousel_actors);
+  carousel_actors = NULL;
+  n_carousel_actors_allocated = 0;
+}
 
-    /* Reset its size: */
-    scale_texture_default (this_item->actor);
+/* Print how fast decoded images of different sizes are made into thumbnails,
+ * in megapixels of the decoded image per second, with and without SSE2,
+ * and with gdk_pixbuf_scale_simple() and gdk_pixbuf_add_alpha(),
+ * as we did before, which still leaves the premultiplying to Cogl:
+ */
+void run_pipeline_benchmark()
+{
+  static const gint sizes[][2] = { { 640, 480 }, { 1600, 1200 }, { 4000, 3000 } };
 
-    angle_start = angle_in_360 (angle_start);
-    angle_end = angle_in_360 (angle_end);
+  g_print ("# size channels mp_per_s mp_per_s_scalar mp_per_s_gdk_pixbuf\n");
 
-    /* Move 360 instead of 0 
-     * when moving for the first time,
-     * and when clicking on something that is already at the front.
-     */
-    if(item_at_front == item)
-      angle_end += 360;
+  guint i = 0;
+  for (i = 0; i < G_N_ELEMENTS (sizes); ++i)
+  {
+    const gint width = sizes[i][0];
+    const gint height = sizes[i][1];
+    const gint thumbnail_width = MAX (1, width * IMAGE_HEIGHT / height);
 
-    clutter_behaviour_ellipse_set_angle_start (
-      CLUTTER_BEHAVIOUR_ELLIPSE (this_item->ellipse_behaviour), angle_start);
-    clutter_behaviour_ellipse_set_angle_end (
-      CLUTTER_BEHAVIOUR_ELLIPSE (this_item->ellipse_behaviour), angle_end);
+    /* Scale about 100 megapixels with each method: */
+    const gint n_runs = MAX (1, 100000000 / (width * height));
+    const gdouble megapixels = (gdouble)width * height * n_runs / 1000000;
 
-    if(this_item == item)
+    gint has_alpha = 0;
+    for (has_alpha = FALSE; has_alpha <= TRUE; ++has_alpha)
     {
-      if(angle_start < angle_end)
-        angle_diff =  angle_end - angle_start;
-      else
-        angle_diff = 360 - (angle_start - angle_end);
-
-      /* printf("  debug: angle diff=%f\n", angle_diff); */
-
+      GdkPixbuf *pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, has_alpha, 8, width, height);
+      guchar *pixels = gdk_pixbuf_get_pixels (pixbuf);
+      const gint rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+      const gint n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+
+      /* Some gradients, with partly transparent parts: */
+      gint y = 0;
+      for (y = 0; y < height; ++y)
+      {
+        guchar *row = pixels + y * rowstride;
+        gint x = 0;
+        for (x = 0; x < width * n_channels; ++x)
+          row[x] = (x * 7 + y * 3) & 0xff;
+      }
+
+      guchar *thumbnail = g_malloc (thumbnail_width * 4 * IMAGE_HEIGHT);
+
+      GTimer *timer = g_timer_new ();
+      gint run = 0;
+      for (run = 0; run < n_runs; ++run)
+        image_pipeline_scale (pixels, width, height, rowstride, has_alpha, TRUE,
+          thumbnail, thumbnail_width, IMAGE_HEIGHT, thumbnail_width * 4);
+      const gdouble pipeline_time = g_timer_elapsed (timer, NULL);
+
+      g_timer_start (timer);
+      for (run = 0; run < n_runs; ++run)
+        image_pipeline_scale_scalar (pixels, width, height, rowstride, has_alpha, TRUE,
+          thumbnail, thumbnail_width, IMAGE_HEIGHT, thumbnail_width * 4);
+      const gdouble scalar_time = g_timer_elapsed (timer, NULL);
+
+      g_timer_start (timer);
+      for (run = 0; run < n_runs; ++run)
+      {
+        GdkPixbuf *scaled = gdk_pixbuf_scale_simple (pixbuf,
+          thumbnail_width, IMAGE_HEIGHT, GDK_INTERP_BILINEAR);
+        if(!has_alpha)
+        {
+          GdkPixbuf *with_alpha = gdk_pixbuf_add_alpha (scaled, FALSE, 0, 0, 0);
+          g_object_unref (scaled);
+          scaled = with_alpha;
+        }
+
+        g_object_unref (scaled);
+      }
+      const gdouble gdk_pixbuf_time = g_timer_elapsed (timer, NULL);
+
+      g_timer_destroy (timer);
+      g_free (thumbnail);
+      g_object_unref (pixbuf);
+
+      g_print ("%dx%d %d %.1f %.1f %.1f\n", width, height, n_channels,
+        megapixels / pipeline_time, megapixels / scalar_time, megapixels / gdk_pixbuf_time);
     }
+  }
+}
 
-    /* TODO: Set the number of frames, depending on the angle.
-     * otherwise the actor will take the same amount of time to reach 
-     * the end angle regardless of how far it must move, causing it to 
-     * move very slowly if it does not have far to move.
-     */
-    angle_end += angle_step;
-    angle_start += angle_step;
-    list = g_slist_next (list);
+/* Make thumbnails of real camera images, from the thumbnails in their EXIF
+ * data where that is possible, then by decoding the JPEG images at a smaller
+ * size, and then by decoding the whole images:
+ */
+void run_thumbnail_benchmark(const gchar *directory_path)
+{
+  GError *error = NULL;
+  GDir* dir = g_dir_open (directory_path, 0, &error);
+  if(error)
+  {
+    g_warning("g_dir_open() failed: %s\n", error->message);
+    g_clear_error(&error);
+    return;
   }
 
-  /* Set the number of frames to be proportional to the distance to travel,
-     so the speed is always the same: */
-  gint pos_to_move = 0;
-  if(pos_front < pos)
+  /* Read each image once first, so both ways find it in the page cache: */
+  GPtrArray *paths = g_ptr_array_new ();
+  const gchar* filename = NULL;
+  while ( (filename = g_dir_read_name(dir)) )
   {
-     const gint count = g_slist_length (list_items);
-     pos_to_move = count + (pos - pos_front);
+    gchar* path = g_build_filename (directory_path, filename, NULL);
+    gchar *contents = NULL;
+    if(image_sniffer_check_file (path, NULL) == IMAGE_SNIFF_OK &&
+       g_file_get_contents (path, &contents, NULL, NULL))
+    {
+      g_ptr_array_add (paths, path);
+      g_free (contents);
+    }
+    else
+      g_free (path);
   }
-  else
+  g_dir_close (dir);
+
+  /* With all the shortcuts, then without the EXIF thumbnails,
+   * and then without any:
+   */
+  static const ImageLoaderDecodeFlags passes[] =
+  {
+    IMAGE_LOADER_USE_EXIF_THUMBNAIL | IMAGE_LOADER_SCALE_WHILE_DECODING,
+    IMAGE_LOADER_SCALE_WHILE_DECODING,
+    0
+  };
+
+  guint n_exif_thumbnails = 0;
+  gdouble times[G_N_ELEMENTS (passes)];
+  GTimer *timer = g_timer_new ();
+
+  guint pass = 0;
+  for (pass = 0; pass < G_N_ELEMENTS (passes); ++pass)
   {
-     pos_to_move = pos_front - pos;
+    g_timer_start (timer);
+
+    guint i = 0;
+    for (i = 0; i < paths->len; ++i)
+    {
+      gboolean used_exif = FALSE;
+      GdkPixbuf *thumbnail = image_loader_decode_file (g_ptr_array_index (paths, i),
+        IMAGE_HEIGHT, passes[pass], &used_exif);
+      if(thumbnail)
+        g_object_unref (thumbnail);
+      if(used_exif)
+        ++n_exif_thumbnails;
+    }
+
+    times[pass] = g_timer_elapsed (timer, NULL);
   }
 
-  clutter_timeline_set_duration (timeline_rotation, angle_diff * 0.2);
+  const guint n_files = MAX (1, paths->len);
+  g_print ("# files exif_thumbnails ms_per_file ms_per_file_scaled_decode ms_per_file_full_decode\n");
+  g_print ("%u %u %.2f %.2f %.2f\n", paths->len, n_exif_thumbnails,
+    times[0] * 1000 / n_files, times[1] * 1000 / n_files, times[2] * 1000 / n_files);
 
-  /* Remember what item will be at the front when this timeline finishes: */
-  item_at_front = item;
+  g_timer_destroy (timer);
 
-  clutter_timeline_start (timeline_rotation);
+  guint i = 0;
+  for (i = 0; i < paths->len; ++i)
+    g_free (g_ptr_array_index (paths, i));
+  g_ptr_array_free (paths, TRUE);
 }
 
-static gboolean
-on_texture_button_press (ClutterActor *actor G_GNUC_UNUSED, ClutterEvent *event G_GNUC_UNUSED, gpointer user_data G_GNUC_UNUSED)
+static void
+on_stage_paint_begin (ClutterActor *actor G_GNUC_UNUSED, gpointer user_data G_GNUC_UNUSED)
 {
-  /* Ignore the events if the timeline_rotation is running (meaning, if the objects are moving),
-   * to simplify things:
-   */
-  if(timeline_rotation && clutter_timeline_is_playing (timeline_rotation))
+  benchmark_begin_sample (benchmark, BENCHMARK_SAMPLE_PAINT);
+}
+
+static void
+on_stage_paint_end (ClutterActor *actor G_GNUC_UNUSED, gpointer user_data G_GNUC_UNUSED)
+{
+  benchmark_end_sample (benchmark, BENCHMARK_SAMPLE_PAINT);
+
+  benchmark_n_culled += example_carousel_group_get_n_culled (EXAMPLE_CAROUSEL_GROUP (carousel_group));
+  ++benchmark_n_painted_frames;
+}
+
+/* Generate the images for the benchmark, with a thumbnail cache of their own,
+ * and return the directory:
+ */
+gchar* create_benchmark_images()
+{
+  gint width = 1600;
+  gint height = 1200;
+  if(benchmark_image_size &&
+     (sscanf (benchmark_image_size, "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0))
   {
-    printf("on_texture_button_press(): ignoring\n");
-    return FALSE;
+    g_warning ("Invalid --benchmark-image-size: %s\n", benchmark_image_size);
+    return NULL;
   }
-  else
-    printf("on_texture_button_press(): handling\n");
 
-  Item *item = (Item*)user_data;
-  rotate_all_until_item_is_at_front (item);
+  GError *error = NULL;
+  gchar *directory_path = benchmark_create_images (benchmark_n_images, width, height, &error);
+  if(error)
+  {
+    g_warning ("benchmark_create_images() failed: %s\n", error->message);
+    g_clear_error (&error);
+    return NULL;
+  }
 
-  return TRUE;
+  /* Start without any cached thumbnails, and don't touch the real cache: */
+  thumbnail_cache_filepath = g_strconcat (directory_path, ".cache", NULL);
+
+  return directory_path;
+}
+
+void print_benchmark_results()
+{
+  gint width = 1600;
+  gint height = 1200;
+  if(benchmark_image_size)
+    sscanf (benchmark_image_size, "%dx%d", &width, &height);
+
+  gdouble arena_bytes = 0, separate_bytes = 0;
+  get_item_bytes (&arena_bytes, &separate_bytes);
+
+  gchar *extra_json = g_strdup_printf ("\"images\": %d, \"image_width\": %d, "
+    "\"image_height\": %d, \"rotations\": %d, \"virtual\": %s, "
+    "\"texture_bytes\": %" G_GSIZE_FORMAT ", \"texture_evictions\": %u, "
+    "\"texture_reloads\": %u, \"cull_occluded\": %s, \"culled_per_frame\": %.1f, "
+    "\"item_bytes\": %.1f, \"item_bytes_separate\": %.1f, "
+    "\"upload_budget_ms\": %d, \"peak_queued_upload_bytes\": %" G_GSIZE_FORMAT ", "
+    "\"recursive\": %s, \"scan_entries_per_s\": %.0f",
+    items ? (gint)items->len : 0, width, height, benchmark_rotation,
+    virtual_mode ? "true" : "false",
+    get_texture_bytes (), n_texture_evictions, n_texture_reloads,
+    cull_occluded ? "true" : "false",
+    benchmark_n_painted_frames ? (gdouble)benchmark_n_culled / benchmark_n_painted_frames : 0.0,
+    arena_bytes, separate_bytes, upload_budget_ms, peak_pending_upload_bytes,
+    recursive ? "true" : "false", scan_entries_per_second);
+  benchmark_print_results (benchmark, stdout, extra_json);
+  g_free (extra_json);
+}
+
+static gsize
+get_resident_texture_bytes (gpointer user_data G_GNUC_UNUSED)
+{
+  return get_texture_bytes ();
 }
 
 int main(int argc, char *argv[])
 {
   ClutterColor stage_color = { 0xB0, 0xB0, 0xB0, 0xff }; /* light gray */
 
-  clutter_init (&argc, &argv);
+  /* The images are decoded in other threads: */
+  g_thread_init (NULL);
+  clutter_threads_init ();
+
+  GError *error = NULL;
+  clutter_init_with_args (&argc, &argv, NULL, option_entries, NULL, &error);
+  if(error)
+  {
+    g_warning ("clutter_init_with_args() failed: %s\n", error->message);
+    g_clear_error (&error);
+    return EXIT_FAILURE;
+  }
+
+  if(benchmark_layout)
+  {
+    run_layout_benchmark ();
+    return EXIT_SUCCESS;
+  }
+
+  if(benchmark_pipeline)
+  {
+    run_pipeline_benchmark ();
+    return EXIT_SUCCESS;
+  }
+
+  if(benchmark_thumbnails_directory)
+  {
+    run_thumbnail_benchmark (benchmark_thumbnails_directory);
+    return EXIT_SUCCESS;
+  }
 
   /* Get the stage and set its size and color: */
   stage = clutter_stage_get_default ();
@@ -387,6 +2832,14 @@ int main(int argc, char *argv[])
   clutter_container_add_actor (CLUTTER_CONTAINER (stage), label_filename);
   clutter_actor_show (label_filename);
 
+  /* Add a group for the images, which sorts them by depth more quickly
+   * than the stage does:
+   */
+  carousel_group = example_carousel_group_new ();
+  example_carousel_group_set_cull_occluded (EXAMPLE_CAROUSEL_GROUP (carousel_group), cull_occluded);
+  clutter_container_add_actor (CLUTTER_CONTAINER (stage), carousel_group);
+  clutter_actor_show (carousel_group);
+
   /* Add a plane under the ellipse of images: */
   ClutterColor rect_color = { 0xff, 0xff, 0xff, 0xff }; /* white */
   ClutterActor *rect = clutter_rectangle_new_with_color (&rect_color);
@@ -398,35 +2851,134 @@ int main(int argc, char *argv[])
     ELLIPSE_Y + IMAGE_HEIGHT - (clutter_actor_get_height (rect) / 2));
   /* Rotate it around its center: */
   clutter_actor_set_rotation (rect, CLUTTER_X_AXIS, -90, 0, (clutter_actor_get_height (rect) / 2), 0);
-  clutter_container_add_actor (CLUTTER_CONTAINER (stage), rect);
+  clutter_container_add_actor (CLUTTER_CONTAINER (carousel_group), rect);
+  example_carousel_group_set_occluder (EXAMPLE_CAROUSEL_GROUP (carousel_group), rect, TRUE);
   clutter_actor_show (rect);
 
+  /* Add the performance overlay, hidden until F1 is pressed: */
+  ClutterActor *perf_hud = example_perf_hud_new (CLUTTER_STAGE (stage));
+  example_perf_hud_set_texture_bytes_func (EXAMPLE_PERF_HUD (perf_hud),
+    get_resident_texture_bytes, NULL);
+  example_perf_hud_set_uploads_func (EXAMPLE_PERF_HUD (perf_hud),
+    get_upload_stats, NULL);
+
   /* Show the stage: */
   clutter_actor_show (stage);
 
-  timeline_rotation = clutter_timeline_new(2000 /* milliseconds */);
-  g_signal_connect (timeline_rotation, "completed", G_CALLBACK (on_timeline_rotation_completed), NULL);
+  /* Measure the benchmark's images instead of ours: */
+  const gchar *images_path = "./images/";
+  gchar *benchmark_directory = NULL;
+  if(benchmark_n_images > 0)
+  {
+    benchmark_directory = create_benchmark_images ();
+    if(!benchmark_directory)
+      return EXIT_FAILURE;
+
+    images_path = benchmark_directory;
+    benchmark = benchmark_new ();
 
-  /* Add an actor for each image: */
-  load_images ("./images/");
-  add_image_actors ();
+    g_signal_connect (stage, "paint", G_CALLBACK (on_stage_paint_begin), NULL);
+    g_signal_connect_after (stage, "paint", G_CALLBACK (on_stage_paint_end), NULL);
+  }
 
-  /* clutter_timeline_set_loop(timeline_rotation, TRUE); */
+  timeline_rotation = clutter_timeline_new(1000 /* milliseconds */);
+  clutter_timeline_set_loop(timeline_rotation, TRUE);
+  motion_timer = g_timer_new ();
+  g_signal_connect (timeline_rotation, "new-frame", G_CALLBACK (on_timeline_rotation_new_frame), NULL);
+  create_moveup_animation ();
 
-  /* Move them a bit to start with: */
-  if(list_items)
-    rotate_all_until_item_is_at_front ((Item*)list_items->data);
+  /* Upload the new textures a few at a time, before each frame: */
+  pending_uploads = g_ptr_array_new ();
+  upload_timer = g_timer_new ();
+  clutter_threads_add_repaint_func (on_repaint_run_pending_uploads, NULL, NULL);
 
+  /* Add an actor for each image, as their files are found: */
+  startup_timer = g_timer_new ();
+  load_images (images_path);
 
   /* Start the main loop, so we can respond to events: */
+  clutter_threads_enter ();
   clutter_main ();
+  clutter_threads_leave ();
+
+  if(benchmark)
+  {
+    benchmark_mark (benchmark, "total_ms");
+    print_benchmark_results ();
+  }
+  else
+  {
+    g_print ("Textures: %" G_GSIZE_FORMAT " bytes resident, %u evictions, %u reloads\n",
+      get_texture_bytes (), n_texture_evictions, n_texture_reloads);
+  }
+
+  /* Stop watching for changes before we free the items: */
+  if(directory_monitor)
+    g_object_unref (directory_monitor);
+  if(pending_changes_source)
+    g_source_remove (pending_changes_source);
+  if(pending_changes)
+    g_hash_table_destroy (pending_changes);
+  g_free (images_directory);
+
+  /* Stop scanning and decoding before we free the items that the images are for: */
+  stop_reading_directory ();
+  if(dir_scanner)
+    dir_scanner_free (dir_scanner);
+  g_free (scan_directory_path);
+  if(read_dir_timer)
+    g_timer_destroy (read_dir_timer);
+  g_timer_destroy (startup_timer);
+  if(image_loader)
+    image_loader_free (image_loader);
+
+  /* Keep any thumbnails that we made before we were closed: */
+  if(thumbnail_cache)
+  {
+    save_thumbnail_cache ();
+    thumbnail_cache_free (thumbnail_cache);
+  }
+
+  /* Forget the waiting uploads before we free the items that they are for: */
+  cancel_all_uploads ();
+  g_ptr_array_free (pending_uploads, TRUE);
+  g_timer_destroy (upload_timer);
 
+  /* Free the slots before the items that they show: */
+  clear_slots ();
+  if(carousel_layout)
+    carousel_layout_free (carousel_layout);
+  g_free (carousel_actors);
 
-  /* Free the list items and the list: */
-  g_slist_foreach(list_items, on_foreach_clear_list_items, NULL);
-  g_slist_free (list_items);
+  /* Free the items and the array: */
+  if(items)
+  {
+    g_hash_table_destroy (items_by_path);
+    g_ptr_array_foreach (items, on_foreach_clear_items, NULL);
+    g_ptr_array_free (items, TRUE);
+  }
+
+  if(item_arena)
+    arena_free (item_arena);
+
+  if(full_images)
+    g_hash_table_destroy (full_images);
 
+  if(texture_atlas)
+    texture_atlas_free (texture_atlas);
+
+  free_moveup_animation ();
   g_object_unref (timeline_rotation);
+  g_timer_destroy (motion_timer);
+
+  if(benchmark)
+  {
+    benchmark_free (benchmark);
+    benchmark_remove_directory (benchmark_directory);
+    g_unlink (thumbnail_cache_filepath);
+    g_free (benchmark_directory);
+  }
+  g_free (thumbnail_cache_filepath);
 
   return EXIT_SUCCESS;
 
@@ -0,0 +1,411 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "perfhud.h"
+#include <clutter/clutter.h>
+#include <cogl/cogl.h>
+#include <cogl/cogl-pango.h>
+
+G_DEFINE_TYPE (ExamplePerfHud, example_perf_hud, CLUTTER_TYPE_ACTOR);
+
+#define HUD_WIDTH 280
+#define HUD_HEIGHT 170
+#define GRAPH_HEIGHT 50
+#define TEXT_UPDATE_INTERVAL 0.25 /* seconds */
+
+/* The frame times that are drawn as the full height of the graph,
+ * and as a line, in seconds:
+ */
+#define GRAPH_MAX_TIME (1.0 / 20)
+#define GRAPH_TARGET_TIME (1.0 / 60)
+
+/* For example_perf_hud_note_material(): */
+static gconstpointer last_material = NULL;
+static guint n_material_changes = 0;
+
+void
+example_perf_hud_note_material (gconstpointer material)
+{
+  if (material == last_material)
+    return;
+
+  last_material = material;
+  ++n_material_changes;
+}
+
+static void
+example_perf_hud_update_text (ExamplePerfHud *hud)
+{
+  const gdouble last_frame_time =
+    hud->frame_times[(hud->frame_index + EXAMPLE_PERF_HUD_N_FRAMES - 1) % EXAMPLE_PERF_HUD_N_FRAMES];
+
+  GString *text = g_string_new (NULL);
+  g_string_append_printf (text, "%.1f fps, frame %.1f ms\n",
+    hud->fps, last_frame_time * 1000);
+  g_string_append_printf (text, "paint %.2f ms, pick %.2f ms\n",
+    hud->paint_time * 1000, hud->pick_time * 1000);
+  g_string_append_printf (text, "layout %.2f ms, image batches ~%u\n",
+    hud->layout_time * 1000, hud->n_image_batches);
+
+  if (hud->texture_bytes_func)
+    g_string_append_printf (text, "textures %.1f MB\n",
+      hud->texture_bytes_func (hud->texture_bytes_data) / (1024.0 * 1024.0));
+
+  if (hud->uploads_func)
+  {
+    gdouble upload_time = 0;
+    gsize queued_bytes = 0;
+    hud->uploads_func (&upload_time, &queued_bytes, hud->uploads_data);
+    g_string_append_printf (text, "uploads %.2f ms, %.1f MB queued",
+      upload_time * 1000, queued_bytes / (1024.0 * 1024.0));
+  }
+
+  if (!hud->layout)
+    hud->layout = clutter_actor_create_pango_layout (CLUTTER_ACTOR (hud), NULL);
+
+  pango_layout_set_text (hud->layout, text->str, -1);
+  g_string_free (text, TRUE);
+}
+
+/* The stage's "paint" signal is emitted before it paints its children: */
+static void
+on_stage_paint (ClutterActor *stage G_GNUC_UNUSED, gpointer user_data)
+{
+  ExamplePerfHud *hud = EXAMPLE_PERF_HUD (user_data);
+  const gdouble now = g_timer_elapsed (hud->timer, NULL);
+
+  if (hud->layout_start)
+  {
+    hud->layout_time = now - hud->layout_start;
+    hud->layout_start = 0;
+  }
+
+  if (hud->frame_start)
+  {
+    hud->frame_times[hud->frame_index] = now - hud->frame_start;
+    hud->frame_index = (hud->frame_index + 1) % EXAMPLE_PERF_HUD_N_FRAMES;
+  }
+  hud->frame_start = now;
+
+  ++hud->frames_this_second;
+  if (now - hud->second_start >= 1.0)
+  {
+    hud->fps = hud->frames_this_second / (now - hud->second_start);
+    hud->frames_this_second = 0;
+    hud->second_start = now;
+  }
+
+  if (now - hud->text_updated >= TEXT_UPDATE_INTERVAL || !hud->layout)
+  {
+    example_perf_hud_update_text (hud);
+    hud->text_updated = now;
+  }
+
+  last_material = NULL;
+  n_material_changes = 0;
+  hud->paint_start = now;
+}
+
+static void
+on_stage_paint_after (ClutterActor *stage G_GNUC_UNUSED, gpointer user_data)
+{
+  ExamplePerfHud *hud = EXAMPLE_PERF_HUD (user_data);
+
+  hud->paint_time = g_timer_elapsed (hud->timer, NULL) - hud->paint_start;
+  hud->n_image_batches = n_material_changes;
+}
+
+/* Clutter calls the repaint functions just before it lays out the stage
+ * for a frame, and then paints it, so the layout is measured from here
+ * until the stage's "paint" signal. This was added when the HUD was shown,
+ * so it runs after the application's repaint functions.
+ */
+static gboolean
+on_repaint_start_layout (gpointer user_data)
+{
+  ExamplePerfHud *hud = EXAMPLE_PERF_HUD (user_data);
+  hud->layout_start = g_timer_elapsed (hud->timer, NULL);
+
+  return TRUE; /* Call this again for the next frame. */
+}
+
+static void
+on_stage_pick (ClutterActor *stage G_GNUC_UNUSED, const ClutterColor *color G_GNUC_UNUSED,
+  gpointer user_data)
+{
+  ExamplePerfHud *hud = EXAMPLE_PERF_HUD (user_data);
+  hud->pick_start = g_timer_elapsed (hud->timer, NULL);
+}
+
+static void
+on_stage_pick_after (ClutterActor *stage G_GNUC_UNUSED, const ClutterColor *color G_GNUC_UNUSED,
+  gpointer user_data)
+{
+  ExamplePerfHud *hud = EXAMPLE_PERF_HUD (user_data);
+  hud->pick_time = g_timer_elapsed (hud->timer, NULL) - hud->pick_start;
+}
+
+static gboolean
+on_stage_key_press (ClutterActor *stage G_GNUC_UNUSED, ClutterEvent *event, gpointer user_data)
+{
+  if (clutter_event_get_key_symbol (event) != CLUTTER_F1)
+    return FALSE;
+
+  ClutterActor *hud = CLUTTER_ACTOR (user_data);
+  if (CLUTTER_ACTOR_IS_VISIBLE (hud))
+    clutter_actor_hide (hud);
+  else
+  {
+    clutter_actor_raise_top (hud);
+    clutter_actor_show (hud);
+  }
+
+  return TRUE;
+}
+
+/* Only measure while the HUD is shown: */
+static void
+example_perf_hud_set_measuring (ExamplePerfHud *hud, gboolean measuring)
+{
+  if (!hud->stage)
+    return;
+
+  if (measuring)
+  {
+    hud->frame_start = 0;
+    hud->second_start = g_timer_elapsed (hud->timer, NULL);
+    hud->frames_this_second = 0;
+
+    g_signal_handler_unblock (hud->stage, hud->paint_handler);
+    g_signal_handler_unblock (hud->stage, hud->paint_after_handler);
+    g_signal_handler_unblock (hud->stage, hud->pick_handler);
+    g_signal_handler_unblock (hud->stage, hud->pick_after_handler);
+
+    hud->layout_start = 0;
+    hud->repaint_func_id = clutter_threads_add_repaint_func (on_repaint_start_layout, hud, NULL);
+  }
+  else
+  {
+    g_signal_handler_block (hud->stage, hud->paint_handler);
+    g_signal_handler_block (hud->stage, hud->paint_after_handler);
+    g_signal_handler_block (hud->stage, hud->pick_handler);
+    g_signal_handler_block (hud->stage, hud->pick_after_handler);
+
+    clutter_threads_remove_repaint_func (hud->repaint_func_id);
+    hud->repaint_func_id = 0;
+  }
+}
+
+static void
+example_perf_hud_show (ClutterActor *actor)
+{
+  if (!CLUTTER_ACTOR_IS_VISIBLE (actor))
+    example_perf_hud_set_measuring (EXAMPLE_PERF_HUD (actor), TRUE);
+
+  CLUTTER_ACTOR_CLASS (example_perf_hud_parent_class)->show (actor);
+}
+
+static void
+example_perf_hud_hide (ClutterActor *actor)
+{
+  if (CLUTTER_ACTOR_IS_VISIBLE (actor))
+    example_perf_hud_set_measuring (EXAMPLE_PERF_HUD (actor), FALSE);
+
+  CLUTTER_ACTOR_CLASS (example_perf_hud_parent_class)->hide (actor);
+}
+
+/* An implementation for the ClutterActor::paint() vfunc: */
+static void
+example_perf_hud_paint (ClutterActor *actor)
+{
+  ExamplePerfHud *hud = EXAMPLE_PERF_HUD (actor);
+  const guint8 opacity = clutter_actor_get_paint_opacity (actor);
+
+  /* The colors are premultiplied: */
+  const guint8 background_alpha = 0xc0 * opacity / 0xff;
+  cogl_set_source_color4ub (0, 0, 0, background_alpha);
+  cogl_rectangle (0, 0, HUD_WIDTH, HUD_HEIGHT);
+
+  /* A bar for each frame, oldest on the left: */
+  const gfloat bar_width = (gfloat)HUD_WIDTH / EXAMPLE_PERF_HUD_N_FRAMES;
+  guint i = 0;
+  for (i = 0; i < EXAMPLE_PERF_HUD_N_FRAMES; ++i)
+  {
+    const gdouble frame_time = hud->frame_times[(hud->frame_index + i) % EXAMPLE_PERF_HUD_N_FRAMES];
+    if (frame_time <= 0)
+      continue;
+
+    const gfloat bar_height = GRAPH_HEIGHT * MIN (frame_time / GRAPH_MAX_TIME, 1.0);
+    if (frame_time <= GRAPH_TARGET_TIME * 1.1)
+      cogl_set_source_color4ub (0, 0xc0 * opacity / 0xff, 0, opacity);
+    else
+      cogl_set_source_color4ub (0xe0 * opacity / 0xff, 0x40 * opacity / 0xff, 0, opacity);
+
+    cogl_rectangle (i * bar_width, HUD_HEIGHT - bar_height,
+      (i + 1) * bar_width, HUD_HEIGHT);
+  }
+
+  /* A line at the target frame time: */
+  const gfloat target_y = HUD_HEIGHT - GRAPH_HEIGHT * (GRAPH_TARGET_TIME / GRAPH_MAX_TIME);
+  cogl_set_source_color4ub (opacity, opacity, opacity, opacity);
+  cogl_rectangle (0, target_y, HUD_WIDTH, target_y + 1);
+
+  if (hud->layout)
+  {
+    CoglColor color;
+    cogl_color_set_from_4ub (&color, opacity, opacity, opacity, opacity);
+    cogl_pango_render_layout (hud->layout, 6, 4, &color, 0);
+  }
+}
+
+/* An implementation for the ClutterActor::get_preferred_width() vfunc: */
+static void
+example_perf_hud_get_preferred_width (ClutterActor *actor G_GNUC_UNUSED,
+                                      gfloat for_height G_GNUC_UNUSED,
+                                      gfloat *min_width_p,
+                                      gfloat *natural_width_p)
+{
+  if (min_width_p)
+    *min_width_p = HUD_WIDTH;
+  if (natural_width_p)
+    *natural_width_p = HUD_WIDTH;
+}
+
+/* An implementation for the ClutterActor::get_preferred_height() vfunc: */
+static void
+example_perf_hud_get_preferred_height (ClutterActor *actor G_GNUC_UNUSED,
+                                       gfloat for_width G_GNUC_UNUSED,
+                                       gfloat *min_height_p,
+                                       gfloat *natural_height_p)
+{
+  if (min_height_p)
+    *min_height_p = HUD_HEIGHT;
+  if (natural_height_p)
+    *natural_height_p = HUD_HEIGHT;
+}
+
+static void
+example_perf_hud_dispose (GObject *object)
+{
+  ExamplePerfHud *hud = EXAMPLE_PERF_HUD (object);
+
+  if (hud->stage)
+  {
+    if (hud->repaint_func_id)
+    {
+      clutter_threads_remove_repaint_func (hud->repaint_func_id);
+      hud->repaint_func_id = 0;
+    }
+
+    g_signal_handler_disconnect (hud->stage, hud->paint_handler);
+    g_signal_handler_disconnect (hud->stage, hud->paint_after_handler);
+    g_signal_handler_disconnect (hud->stage, hud->pick_handler);
+    g_signal_handler_disconnect (hud->stage, hud->pick_after_handler);
+    g_signal_handler_disconnect (hud->stage, hud->key_press_handler);
+    hud->stage = NULL;
+  }
+
+  if (hud->layout)
+  {
+    g_object_unref (hud->layout);
+    hud->layout = NULL;
+  }
+
+  G_OBJECT_CLASS (example_perf_hud_parent_class)->dispose (object);
+}
+
+static void
+example_perf_hud_finalize (GObject *object)
+{
+  g_timer_destroy (EXAMPLE_PERF_HUD (object)->timer);
+
+  G_OBJECT_CLASS (example_perf_hud_parent_class)->finalize (object);
+}
+
+static void
+example_perf_hud_class_init (ExamplePerfHudClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  ClutterActorClass *actor_class = CLUTTER_ACTOR_CLASS (klass);
+
+  /* Provide implementations for ClutterActor vfuncs: */
+  actor_class->paint = example_perf_hud_paint;
+  actor_class->get_preferred_width = example_perf_hud_get_preferred_width;
+  actor_class->get_preferred_height = example_perf_hud_get_preferred_height;
+  actor_class->show = example_perf_hud_show;
+  actor_class->hide = example_perf_hud_hide;
+
+  gobject_class->dispose = example_perf_hud_dispose;
+  gobject_class->finalize = example_perf_hud_finalize;
+}
+
+static void
+example_perf_hud_init (ExamplePerfHud *hud)
+{
+  hud->timer = g_timer_new ();
+}
+
+ClutterActor *
+example_perf_hud_new (ClutterStage *stage)
+{
+  g_return_val_if_fail (CLUTTER_IS_STAGE (stage), NULL);
+
+  ExamplePerfHud *hud = g_object_new (EXAMPLE_TYPE_PERF_HUD, NULL);
+  hud->stage = CLUTTER_ACTOR (stage);
+
+  hud->paint_handler = g_signal_connect (stage, "paint",
+    G_CALLBACK (on_stage_paint), hud);
+  hud->paint_after_handler = g_signal_connect_after (stage, "paint",
+    G_CALLBACK (on_stage_paint_after), hud);
+  hud->pick_handler = g_signal_connect (stage, "pick",
+    G_CALLBACK (on_stage_pick), hud);
+  hud->pick_after_handler = g_signal_connect_after (stage, "pick",
+    G_CALLBACK (on_stage_pick_after), hud);
+  hud->key_press_handler = g_signal_connect (stage, "key-press-event",
+    G_CALLBACK (on_stage_key_press), hud);
+
+  /* Don't measure anything until the HUD is shown: */
+  g_signal_handler_block (stage, hud->paint_handler);
+  g_signal_handler_block (stage, hud->paint_after_handler);
+  g_signal_handler_block (stage, hud->pick_handler);
+  g_signal_handler_block (stage, hud->pick_after_handler);
+
+  g_object_set (hud, "show-on-set-parent", FALSE, NULL);
+  clutter_container_add_actor (CLUTTER_CONTAINER (stage), CLUTTER_ACTOR (hud));
+  clutter_actor_set_position (CLUTTER_ACTOR (hud), 10, 60);
+
+  return CLUTTER_ACTOR (hud);
+}
+
+void
+example_perf_hud_set_texture_bytes_func (ExamplePerfHud *hud,
+  ExamplePerfHudBytesFunc func, gpointer user_data)
+{
+  g_return_if_fail (EXAMPLE_IS_PERF_HUD (hud));
+
+  hud->texture_bytes_func = func;
+  hud->texture_bytes_data = user_data;
+}
+
+void
+example_perf_hud_set_uploads_func (ExamplePerfHud *hud,
+  ExamplePerfHudUploadsFunc func, gpointer user_data)
+{
+  g_return_if_fail (EXAMPLE_IS_PERF_HUD (hud));
+
+  hud->uploads_func = func;
+  hud->uploads_data = user_data;
+}
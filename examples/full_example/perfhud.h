@@ -0,0 +1,129 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef __EXAMPLE_PERF_HUD_H__
+#define __EXAMPLE_PERF_HUD_H__
+
+#include <clutter/clutter.h>
+#include <pango/pango.h>
+
+G_BEGIN_DECLS
+
+#define EXAMPLE_TYPE_PERF_HUD                (example_perf_hud_get_type ())
+#define EXAMPLE_PERF_HUD(obj)                (G_TYPE_CHECK_INSTANCE_CAST ((obj), EXAMPLE_TYPE_PERF_HUD, ExamplePerfHud))
+#define EXAMPLE_IS_PERF_HUD(obj)             (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EXAMPLE_TYPE_PERF_HUD))
+#define EXAMPLE_PERF_HUD_CLASS(klass)        (G_TYPE_CHECK_CLASS_CAST ((klass), EXAMPLE_TYPE_PERF_HUD, ExamplePerfHudClass))
+#define EXAMPLE_IS_PERF_HUD_CLASS(klass)     (G_TYPE_CHECK_CLASS_TYPE ((klass), EXAMPLE_TYPE_PERF_HUD))
+#define EXAMPLE_PERF_HUD_GET_CLASS(obj)      (G_TYPE_INSTANCE_GET_CLASS ((obj), EXAMPLE_TYPE_PERF_HUD, ExamplePerfHudClass))
+
+/* The number of frames shown in the graph: */
+#define EXAMPLE_PERF_HUD_N_FRAMES 120
+
+typedef struct _ExamplePerfHud       ExamplePerfHud;
+typedef struct _ExamplePerfHudClass  ExamplePerfHudClass;
+
+/* Returns the number of bytes of texture memory that the application uses. */
+typedef gsize (*ExamplePerfHudBytesFunc) (gpointer user_data);
+
+/* Gets the time spent uploading textures in the last frame, in seconds,
+ * and the number of bytes of textures that are waiting to be uploaded.
+ */
+typedef void (*ExamplePerfHudUploadsFunc) (gdouble  *upload_time,
+                                           gsize    *queued_bytes,
+                                           gpointer  user_data);
+
+/* An overlay that shows the frame rate, a graph of the frame times,
+ * the time spent painting, picking and laying out the stage in each frame,
+ * the number of batches that the example's images are drawn in, the texture
+ * memory, and the texture uploads.
+ * It is hidden at first, and is shown and hidden by pressing F1.
+ * While it is hidden, it does not measure anything.
+ */
+struct _ExamplePerfHud
+{
+  /*< private >*/
+  ClutterActor parent_instance;
+
+  ClutterActor *stage;
+  gulong paint_handler;
+  gulong paint_after_handler;
+  gulong pick_handler;
+  gulong pick_after_handler;
+  gulong key_press_handler;
+  guint repaint_func_id;
+
+  GTimer *timer;
+  gdouble paint_start;
+  gdouble pick_start;
+  gdouble frame_start;
+  gdouble layout_start;
+
+  /* The times of the last frame, in seconds: */
+  gdouble paint_time;
+  gdouble pick_time;
+  gdouble layout_time;
+  guint n_image_batches;
+
+  /* The times between frames, in seconds, oldest first from frame_index: */
+  gdouble frame_times[EXAMPLE_PERF_HUD_N_FRAMES];
+  guint frame_index;
+
+  guint frames_this_second;
+  gdouble second_start;
+  gdouble fps;
+
+  ExamplePerfHudBytesFunc texture_bytes_func;
+  gpointer texture_bytes_data;
+
+  ExamplePerfHudUploadsFunc uploads_func;
+  gpointer uploads_data;
+
+  /* The text is only updated a few times a second, so it stays readable: */
+  PangoLayout *layout;
+  gdouble text_updated;
+};
+
+struct _ExamplePerfHudClass
+{
+  /*< private >*/
+  ClutterActorClass parent_class;
+};
+
+
+GType example_perf_hud_get_type (void) G_GNUC_CONST;
+
+/* Create a HUD and add it to the stage. */
+ClutterActor *example_perf_hud_new (ClutterStage *stage);
+
+void example_perf_hud_set_texture_bytes_func (ExamplePerfHud          *hud,
+                                              ExamplePerfHudBytesFunc  func,
+                                              gpointer                 user_data);
+
+void example_perf_hud_set_uploads_func (ExamplePerfHud            *hud,
+                                        ExamplePerfHudUploadsFunc  func,
+                                        gpointer                   user_data);
+
+/* Actors that draw with Cogl can call this before each rectangle that they
+ * draw with a material, so the HUD can count how often the material changes.
+ * Cogl draws consecutive rectangles with the same material in one batch,
+ * so this is the number of batches among the actors that call this,
+ * not the number of draw calls of the whole stage.
+ */
+void example_perf_hud_note_material (gconstpointer material);
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_PERF_HUD_H__ */
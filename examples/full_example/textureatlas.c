@@ -0,0 +1,531 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "textureatlas.h"
+
+#include <clutter/clutter.h>
+#include <string.h>
+
+/* Each image has a border of this many pixels, copied from its edges,
+ * so that linear filtering at the edges does not pick up its neighbours:
+ */
+#define BORDER 1
+
+/* The pages keep premultiplied pixels, like ClutterTexture does: */
+#define PAGE_FORMAT COGL_PIXEL_FORMAT_RGBA_8888_PRE
+
+typedef struct _TextureAtlasPage TextureAtlasPage;
+
+/* The top edge of the used part of a page, from x to x + width: */
+typedef struct _SkylineSegment
+{
+  gint x;
+  gint y;
+  gint width;
+}
+SkylineSegment;
+
+struct _TextureAtlasPage
+{
+  TextureAtlas *atlas;
+  CoglHandle texture;
+  CoglHandle material;
+
+  /* SkylineSegments, from left to right, covering the whole width: */
+  GArray *skyline;
+
+  /* The TextureAtlasRegions in this page: */
+  GQueue regions;
+
+  /* The area of the regions in this page, and the area that has been used
+   * up since the page was last packed, including removed regions.
+   * When much of the used area is no longer needed, we repack the page.
+   */
+  gint64 live_area;
+  gint64 packed_area;
+
+  guint repack_source_id;
+};
+
+struct _TextureAtlasRegion
+{
+  TextureAtlasPage *page;
+  GList *link;
+
+  /* The position of the image in the page, not including the border: */
+  gint x;
+  gint y;
+  gint width;
+  gint height;
+};
+
+struct _TextureAtlas
+{
+  gint page_size;
+  GPtrArray *pages;
+
+  TextureAtlasChangedFunc changed_func;
+  gpointer user_data;
+};
+
+static gint64
+get_packed_area (gint width, gint height)
+{
+  return (gint64)(width + 2 * BORDER) * (height + 2 * BORDER);
+}
+
+static void
+texture_atlas_page_reset_skyline (TextureAtlasPage *page)
+{
+  SkylineSegment segment = { 0, 0, page->atlas->page_size };
+  g_array_set_size (page->skyline, 0);
+  g_array_append_val (page->skyline, segment);
+  page->packed_area = 0;
+}
+
+static TextureAtlasPage*
+texture_atlas_page_new (TextureAtlas *atlas)
+{
+  CoglHandle texture = cogl_texture_new_with_size (atlas->page_size, atlas->page_size,
+    COGL_TEXTURE_NO_AUTO_MIPMAP, PAGE_FORMAT);
+  if (texture == COGL_INVALID_HANDLE)
+    return NULL;
+
+  TextureAtlasPage *page = g_slice_new0 (TextureAtlasPage);
+  page->atlas = atlas;
+  page->texture = texture;
+  page->material = cogl_material_new ();
+  cogl_material_set_layer (page->material, 0, page->texture);
+  page->skyline = g_array_new (FALSE, FALSE, sizeof (SkylineSegment));
+  g_queue_init (&page->regions);
+  texture_atlas_page_reset_skyline (page);
+
+  return page;
+}
+
+static void
+texture_atlas_page_free (TextureAtlasPage *page)
+{
+  /* The regions stay valid, but empty, until their owners free them: */
+  GList *link = NULL;
+  for (link = page->regions.head; link; link = link->next)
+  {
+    TextureAtlasRegion *region = (TextureAtlasRegion*)link->data;
+    region->page = NULL;
+    region->link = NULL;
+  }
+  g_queue_clear (&page->regions);
+
+  if (page->repack_source_id)
+    g_source_remove (page->repack_source_id);
+
+  g_array_free (page->skyline, TRUE);
+  cogl_handle_unref (page->material);
+  cogl_handle_unref (page->texture);
+  g_slice_free (TextureAtlasPage, page);
+}
+
+/* Find the lowest y at which a rectangle of this width fits,
+ * with its left edge at the start of this segment.
+ * Returns -1 if it doesn't fit.
+ */
+static gint
+texture_atlas_page_fit (TextureAtlasPage *page, guint index, gint width, gint height)
+{
+  const gint page_size = page->atlas->page_size;
+  const SkylineSegment *segment = &g_array_index (page->skyline, SkylineSegment, index);
+  if (segment->x + width > page_size)
+    return -1;
+
+  gint y = 0;
+  gint remaining = width;
+  while (remaining > 0)
+  {
+    /* The segments always cover the whole width, so we can't run out: */
+    segment = &g_array_index (page->skyline, SkylineSegment, index);
+    y = MAX (y, segment->y);
+    if (y + height > page_size)
+      return -1;
+
+    remaining -= segment->width;
+    ++index;
+  }
+
+  return y;
+}
+
+/* Find a place for a rectangle of this size, choosing the lowest place,
+ * and then the narrowest segment, to keep the skyline flat.
+ */
+static gboolean
+texture_atlas_page_allocate (TextureAtlasPage *page, gint width, gint height, gint *x, gint *y)
+{
+  gint best_index = -1;
+  gint best_y = G_MAXINT;
+  gint best_width = G_MAXINT;
+
+  guint i = 0;
+  for (i = 0; i < page->skyline->len; ++i)
+  {
+    const gint fit_y = texture_atlas_page_fit (page, i, width, height);
+    if (fit_y < 0)
+      continue;
+
+    const SkylineSegment *segment = &g_array_index (page->skyline, SkylineSegment, i);
+    if (fit_y < best_y || (fit_y == best_y && segment->width < best_width))
+    {
+      best_index = i;
+      best_y = fit_y;
+      best_width = segment->width;
+    }
+  }
+
+  if (best_index < 0)
+    return FALSE;
+
+  /* Add a segment for the top of the new rectangle,
+   * and shrink or remove the segments that are now under it:
+   */
+  SkylineSegment added;
+  added.x = g_array_index (page->skyline, SkylineSegment, best_index).x;
+  added.y = best_y + height;
+  added.width = width;
+  g_array_insert_val (page->skyline, best_index, added);
+
+  i = best_index + 1;
+  while (i < page->skyline->len)
+  {
+    SkylineSegment *segment = &g_array_index (page->skyline, SkylineSegment, i);
+    const gint overlap = added.x + added.width - segment->x;
+    if (overlap <= 0)
+      break;
+
+    if (overlap < segment->width)
+    {
+      segment->x += overlap;
+      segment->width -= overlap;
+      break;
+    }
+
+    g_array_remove_index (page->skyline, i);
+  }
+
+  /* Merge neighbouring segments of the same height: */
+  i = 0;
+  while (i + 1 < page->skyline->len)
+  {
+    SkylineSegment *segment = &g_array_index (page->skyline, SkylineSegment, i);
+    const SkylineSegment *next = &g_array_index (page->skyline, SkylineSegment, i + 1);
+    if (segment->y == next->y)
+    {
+      segment->width += next->width;
+      g_array_remove_index (page->skyline, i + 1);
+    }
+    else
+      ++i;
+  }
+
+  page->packed_area += (gint64)width * height;
+
+  *x = added.x;
+  *y = best_y;
+  return TRUE;
+}
+
+/* Upload the image with its border, copying its edge pixels into the border: */
+static void
+texture_atlas_page_upload (TextureAtlasPage *page, gint x, gint y,
+  const guchar *pixels, gint width, gint height, gint rowstride, CoglPixelFormat format)
+{
+  const gint padded_width = width + 2 * BORDER;
+  const gint padded_height = height + 2 * BORDER;
+  const gint padded_rowstride = padded_width * 4;
+  guchar *padded = g_malloc (padded_rowstride * padded_height);
+
+  gint row = 0;
+  for (row = 0; row < padded_height; ++row)
+  {
+    const gint source_row = CLAMP (row - BORDER, 0, height - 1);
+    const guchar *source = pixels + source_row * rowstride;
+    guchar *dest = padded + row * padded_rowstride;
+
+    gint column = 0;
+    for (column = 0; column < BORDER; ++column)
+    {
+      memcpy (dest + column * 4, source, 4);
+      memcpy (dest + (BORDER + width + column) * 4, source + (width - 1) * 4, 4);
+    }
+
+    memcpy (dest + BORDER * 4, source, width * 4);
+  }
+
+  cogl_texture_set_region (page->texture, 0, 0, x, y,
+    padded_width, padded_height, padded_width, padded_height,
+    format, padded_rowstride, padded);
+
+  g_free (padded);
+}
+
+static gboolean
+texture_atlas_page_add_region (TextureAtlasPage *page, TextureAtlasRegion *region,
+  const guchar *pixels, gint rowstride, CoglPixelFormat format)
+{
+  gint x = 0;
+  gint y = 0;
+  if (!texture_atlas_page_allocate (page,
+        region->width + 2 * BORDER, region->height + 2 * BORDER, &x, &y))
+    return FALSE;
+
+  texture_atlas_page_upload (page, x, y, pixels,
+    region->width, region->height, rowstride, format);
+
+  region->page = page;
+  region->x = x + BORDER;
+  region->y = y + BORDER;
+  g_queue_push_tail (&page->regions, region);
+  region->link = page->regions.tail;
+  page->live_area += get_packed_area (region->width, region->height);
+
+  return TRUE;
+}
+
+/* Put the region in the first page, other than except, that has room for it,
+ * or in a new page if new_page is TRUE:
+ */
+static gboolean
+texture_atlas_add_region (TextureAtlas *atlas, TextureAtlasRegion *region,
+  const guchar *pixels, gint rowstride, CoglPixelFormat format, TextureAtlasPage *except,
+  gboolean new_page)
+{
+  guint i = 0;
+  for (i = 0; i < atlas->pages->len; ++i)
+  {
+    TextureAtlasPage *page = (TextureAtlasPage*)g_ptr_array_index (atlas->pages, i);
+    if (page != except &&
+        texture_atlas_page_add_region (page, region, pixels, rowstride, format))
+      return TRUE;
+  }
+
+  if (!new_page)
+    return FALSE;
+
+  TextureAtlasPage *page = texture_atlas_page_new (atlas);
+  if (!page)
+    return FALSE;
+
+  g_ptr_array_add (atlas->pages, page);
+  return texture_atlas_page_add_region (page, region, pixels, rowstride, format);
+}
+
+static gint
+compare_region_height (gconstpointer a, gconstpointer b, gpointer user_data G_GNUC_UNUSED)
+{
+  const TextureAtlasRegion *region_a = (const TextureAtlasRegion*)a;
+  const TextureAtlasRegion *region_b = (const TextureAtlasRegion*)b;
+
+  /* Tallest first, which packs best with a skyline: */
+  return region_b->height - region_a->height;
+}
+
+/* Pack the page's regions again from the start, reading their pixels back
+ * from the page's texture. The regions are moved into the other pages first,
+ * where they fit, so that sparse pages are merged. The page is freed if that
+ * leaves it empty.
+ */
+static void
+texture_atlas_page_repack (TextureAtlasPage *page)
+{
+  TextureAtlas *atlas = page->atlas;
+  const gint page_size = page->atlas->page_size;
+  const gint page_rowstride = page_size * 4;
+  guchar *page_pixels = g_malloc (page_rowstride * page_size);
+  cogl_texture_get_data (page->texture, PAGE_FORMAT, page_rowstride, page_pixels);
+
+  GQueue regions = page->regions;
+  g_queue_init (&page->regions);
+  g_queue_sort (&regions, compare_region_height, NULL);
+  page->live_area = 0;
+  texture_atlas_page_reset_skyline (page);
+
+  TextureAtlasRegion *region = NULL;
+  while ((region = (TextureAtlasRegion*)g_queue_pop_head (&regions)))
+  {
+    const guchar *pixels = page_pixels + region->y * page_rowstride + region->x * 4;
+
+    /* Putting it back in this page can only fail if the new packing is
+     * worse than the old one, in which case we need a new page for it:
+     */
+    if (!texture_atlas_add_region (atlas, region, pixels, page_rowstride, PAGE_FORMAT, page, FALSE) &&
+        !texture_atlas_page_add_region (page, region, pixels, page_rowstride, PAGE_FORMAT) &&
+        !texture_atlas_add_region (atlas, region, pixels, page_rowstride, PAGE_FORMAT, page, TRUE))
+    {
+      region->page = NULL;
+      region->link = NULL;
+    }
+  }
+
+  g_free (page_pixels);
+
+  if (g_queue_is_empty (&page->regions))
+  {
+    /* Release the page's texture memory: */
+    g_ptr_array_remove (atlas->pages, page);
+    texture_atlas_page_free (page);
+  }
+}
+
+static gboolean
+on_idle_repack (gpointer data)
+{
+  TextureAtlasPage *page = (TextureAtlasPage*)data;
+  TextureAtlas *atlas = page->atlas;
+  page->repack_source_id = 0;
+
+  texture_atlas_page_repack (page);
+
+  if (atlas->changed_func)
+    atlas->changed_func (atlas, atlas->user_data);
+
+  return FALSE; /* Don't call this again. */
+}
+
+TextureAtlas*
+texture_atlas_new (gint page_size, TextureAtlasChangedFunc changed_func, gpointer user_data)
+{
+  g_return_val_if_fail (page_size > 2 * BORDER, NULL);
+
+  TextureAtlas *atlas = g_new0 (TextureAtlas, 1);
+  atlas->page_size = page_size;
+  atlas->pages = g_ptr_array_new ();
+  atlas->changed_func = changed_func;
+  atlas->user_data = user_data;
+
+  return atlas;
+}
+
+void
+texture_atlas_free (TextureAtlas *atlas)
+{
+  g_return_if_fail (atlas);
+
+  guint i = 0;
+  for (i = 0; i < atlas->pages->len; ++i)
+    texture_atlas_page_free ((TextureAtlasPage*)g_ptr_array_index (atlas->pages, i));
+
+  g_ptr_array_free (atlas->pages, TRUE);
+  g_free (atlas);
+}
+
+TextureAtlasRegion*
+texture_atlas_add (TextureAtlas *atlas, const guchar *pixels,
+  gint width, gint height, gint rowstride)
+{
+  g_return_val_if_fail (atlas, NULL);
+  g_return_val_if_fail (pixels, NULL);
+  g_return_val_if_fail (width > 0 && height > 0, NULL);
+
+  if (width + 2 * BORDER > atlas->page_size || height + 2 * BORDER > atlas->page_size)
+    return NULL;
+
+  TextureAtlasRegion *region = g_slice_new0 (TextureAtlasRegion);
+  region->width = width;
+  region->height = height;
+
+  if (!texture_atlas_add_region (atlas, region, pixels, rowstride, PAGE_FORMAT, NULL, TRUE))
+  {
+    g_slice_free (TextureAtlasRegion, region);
+    return NULL;
+  }
+
+  return region;
+}
+
+guint
+texture_atlas_get_n_pages (TextureAtlas *atlas)
+{
+  g_return_val_if_fail (atlas, 0);
+
+  return atlas->pages->len;
+}
+
+gsize
+texture_atlas_get_bytes (TextureAtlas *atlas)
+{
+  g_return_val_if_fail (atlas, 0);
+
+  return (gsize)atlas->pages->len * atlas->page_size * atlas->page_size * 4;
+}
+
+void
+texture_atlas_region_free (TextureAtlasRegion *region)
+{
+  g_return_if_fail (region);
+
+  TextureAtlasPage *page = region->page;
+  if (page)
+  {
+    g_queue_delete_link (&page->regions, region->link);
+    page->live_area -= get_packed_area (region->width, region->height);
+
+    if (g_queue_is_empty (&page->regions))
+    {
+      /* Release the page's texture memory: */
+      g_ptr_array_remove (page->atlas->pages, page);
+      texture_atlas_page_free (page);
+    }
+    else if (page->live_area * 2 < page->packed_area && !page->repack_source_id)
+    {
+      /* Wait until the main loop is idle, so that we repack only once
+       * when many regions are removed together:
+       */
+      page->repack_source_id = clutter_threads_add_idle (on_idle_repack, page);
+    }
+  }
+
+  g_slice_free (TextureAtlasRegion, region);
+}
+
+void
+texture_atlas_region_get_size (TextureAtlasRegion *region, gint *width, gint *height)
+{
+  g_return_if_fail (region);
+
+  if (width)
+    *width = region->width;
+  if (height)
+    *height = region->height;
+}
+
+CoglHandle
+texture_atlas_region_get_material (TextureAtlasRegion *region)
+{
+  g_return_val_if_fail (region, COGL_INVALID_HANDLE);
+
+  return region->page ? region->page->material : COGL_INVALID_HANDLE;
+}
+
+void
+texture_atlas_region_get_coords (TextureAtlasRegion *region,
+  gfloat *tx1, gfloat *ty1, gfloat *tx2, gfloat *ty2)
+{
+  g_return_if_fail (region);
+
+  const gfloat page_size = region->page ? region->page->atlas->page_size : 1;
+  *tx1 = region->x / page_size;
+  *ty1 = region->y / page_size;
+  *tx2 = (region->x + region->width) / page_size;
+  *ty2 = (region->y + region->height) / page_size;
+}
@@ -0,0 +1,84 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef __EXAMPLE_TEXTURE_ATLAS_H__
+#define __EXAMPLE_TEXTURE_ATLAS_H__
+
+#include <glib.h>
+#include <cogl/cogl.h>
+
+G_BEGIN_DECLS
+
+/* Packs many small images into a few large textures (pages), using a skyline
+ * for each page, so that they can all be drawn with the same few textures.
+ * Pages are repacked when enough of their images have been removed, moving
+ * what fits into the other pages, and released when all of them have been
+ * moved or removed.
+ */
+typedef struct _TextureAtlas       TextureAtlas;
+typedef struct _TextureAtlasRegion TextureAtlasRegion;
+
+/* Called when images have been moved to new places in the pages,
+ * so that anything showing them should be redrawn.
+ */
+typedef void (*TextureAtlasChangedFunc) (TextureAtlas *atlas, gpointer user_data);
+
+TextureAtlas       *texture_atlas_new (gint                     page_size,
+                                       TextureAtlasChangedFunc  changed_func,
+                                       gpointer                 user_data);
+
+/* Any regions that have not been freed yet become empty. */
+void                texture_atlas_free (TextureAtlas *atlas);
+
+/* Copy premultiplied RGBA pixels into one of the pages.
+ * Returns NULL if the image is too big for a page.
+ */
+TextureAtlasRegion *texture_atlas_add (TextureAtlas *atlas,
+                                       const guchar *pixels,
+                                       gint          width,
+                                       gint          height,
+                                       gint          rowstride);
+
+guint               texture_atlas_get_n_pages (TextureAtlas *atlas);
+
+/* The texture memory of all the pages. A page is released when its last
+ * region is freed, or when its regions have been moved to other pages,
+ * which happens when the main loop is next idle.
+ */
+gsize               texture_atlas_get_bytes (TextureAtlas *atlas);
+
+void                texture_atlas_region_free (TextureAtlasRegion *region);
+
+void                texture_atlas_region_get_size (TextureAtlasRegion *region,
+                                                   gint               *width,
+                                                   gint               *height);
+
+/* The material of the region's page, so that regions on the same page can be
+ * drawn in one batch, and the region's texture coordinates in that page.
+ * The material is COGL_INVALID_HANDLE if the region is empty.
+ * The region may be moved when its page is repacked, so get these again
+ * each time the region is drawn.
+ */
+CoglHandle          texture_atlas_region_get_material (TextureAtlasRegion *region);
+void                texture_atlas_region_get_coords (TextureAtlasRegion *region,
+                                                     gfloat             *tx1,
+                                                     gfloat             *ty1,
+                                                     gfloat             *tx2,
+                                                     gfloat             *ty2);
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_TEXTURE_ATLAS_H__ */
@@ -0,0 +1,479 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "thumbnailcache.h"
+
+#include <glib/gstdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <string.h>
+
+/* The layout of the cache file is:
+ *   ThumbnailCacheHeader
+ *   ThumbnailCacheRecord * n_records
+ *   The nul-terminated file paths.
+ *   The pixels of each thumbnail, each starting at a multiple of PIXELS_ALIGNMENT.
+ * All numbers are in the native byte order, because the file is never
+ * shared between machines.
+ */
+#define CACHE_MAGIC "CTTHUMB1"
+/* Version 2 has premultiplied pixels: */
+#define CACHE_VERSION 2
+#define PIXELS_ALIGNMENT 16
+
+typedef struct _ThumbnailCacheHeader
+{
+  gchar magic[8];
+  guint32 version;
+  guint32 n_records;
+  guint64 file_length;
+  guint64 reserved;
+}
+ThumbnailCacheHeader;
+
+typedef struct _ThumbnailCacheRecord
+{
+  guint64 file_size;
+  gint64 file_mtime;
+  guint64 pixels_offset;
+  guint32 path_offset;
+  guint32 width;
+  guint32 height;
+  guint32 rowstride;
+}
+ThumbnailCacheRecord;
+
+/* What we know about one thumbnail, either from the mapped file
+ * or from thumbnail_cache_add():
+ */
+typedef struct _ThumbnailCacheEntry
+{
+  guint64 file_size;
+  gint64 file_mtime;
+  gint width;
+  gint height;
+  gint rowstride;
+
+  /* One of these is set: */
+  const guchar *mapped_pixels;
+  GdkPixbuf *pixbuf;
+
+  /* Whether this should be written by the next save: */
+  gboolean used;
+}
+ThumbnailCacheEntry;
+
+struct _ThumbnailCache
+{
+  gchar *filepath;
+  GMappedFile *mapped_file;
+
+  /* The key is "<height>:<filepath>", so one file can have thumbnails of
+   * several heights. The value is a ThumbnailCacheEntry.
+   */
+  GHashTable *entries;
+
+  gboolean dirty;
+};
+
+static void
+thumbnail_cache_entry_free (gpointer data)
+{
+  ThumbnailCacheEntry *entry = (ThumbnailCacheEntry*)data;
+
+  if (entry->pixbuf)
+    g_object_unref (entry->pixbuf);
+
+  g_slice_free (ThumbnailCacheEntry, entry);
+}
+
+static gchar*
+make_key (const gchar *filepath, gint height)
+{
+  return g_strdup_printf ("%d:%s", height, filepath);
+}
+
+static gboolean
+get_file_stat (const gchar *filepath, guint64 *file_size, gint64 *file_mtime)
+{
+  struct stat buf;
+  if (g_stat (filepath, &buf) != 0)
+    return FALSE;
+
+  *file_size = buf.st_size;
+  *file_mtime = buf.st_mtime;
+  return TRUE;
+}
+
+/* Check that the mapped file is one of ours and that nothing in it
+ * points outside of it, then add its thumbnails to the hash table.
+ */
+static void
+thumbnail_cache_read_mapped_file (ThumbnailCache *cache)
+{
+  const gchar *contents = g_mapped_file_get_contents (cache->mapped_file);
+  const gsize length = g_mapped_file_get_length (cache->mapped_file);
+
+  if (length < sizeof (ThumbnailCacheHeader))
+    return;
+
+  const ThumbnailCacheHeader *header = (const ThumbnailCacheHeader*)contents;
+  if (memcmp (header->magic, CACHE_MAGIC, sizeof (header->magic)) != 0 ||
+      header->version != CACHE_VERSION ||
+      header->file_length != length)
+  {
+    return;
+  }
+
+  const gsize records_end = sizeof (ThumbnailCacheHeader) +
+    (gsize)header->n_records * sizeof (ThumbnailCacheRecord);
+  if (records_end > length)
+    return;
+
+  const ThumbnailCacheRecord *records =
+    (const ThumbnailCacheRecord*)(contents + sizeof (ThumbnailCacheHeader));
+
+  guint i = 0;
+  for (i = 0; i < header->n_records; ++i)
+  {
+    const ThumbnailCacheRecord *record = &records[i];
+
+    if (record->path_offset < records_end || record->path_offset >= length ||
+        !memchr (contents + record->path_offset, '\0', length - record->path_offset))
+      continue;
+
+    if (record->rowstride < record->width * 4 ||
+        record->pixels_offset % PIXELS_ALIGNMENT != 0 ||
+        record->pixels_offset > length ||
+        (guint64)record->rowstride * record->height > length - record->pixels_offset)
+      continue;
+
+    ThumbnailCacheEntry *entry = g_slice_new0 (ThumbnailCacheEntry);
+    entry->file_size = record->file_size;
+    entry->file_mtime = record->file_mtime;
+    entry->width = record->width;
+    entry->height = record->height;
+    entry->rowstride = record->rowstride;
+    entry->mapped_pixels = (const guchar*)contents + record->pixels_offset;
+
+    g_hash_table_replace (cache->entries,
+      make_key (contents + record->path_offset, record->height), entry);
+  }
+}
+
+static void
+thumbnail_cache_map (ThumbnailCache *cache)
+{
+  if (!g_file_test (cache->filepath, G_FILE_TEST_IS_REGULAR))
+    return;
+
+  GError *error = NULL;
+  cache->mapped_file = g_mapped_file_new (cache->filepath, FALSE, &error);
+  if (error)
+  {
+    g_warning ("g_mapped_file_new() failed for %s: %s\n", cache->filepath, error->message);
+    g_clear_error (&error);
+    return;
+  }
+
+  thumbnail_cache_read_mapped_file (cache);
+}
+
+static void
+thumbnail_cache_unmap (ThumbnailCache *cache)
+{
+  if (!cache->mapped_file)
+    return;
+
+  g_mapped_file_free (cache->mapped_file);
+  cache->mapped_file = NULL;
+}
+
+ThumbnailCache*
+thumbnail_cache_new (const gchar *cache_filepath)
+{
+  g_return_val_if_fail (cache_filepath, NULL);
+
+  ThumbnailCache *cache = g_new0 (ThumbnailCache, 1);
+  cache->filepath = g_strdup (cache_filepath);
+  cache->entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+    g_free, thumbnail_cache_entry_free);
+
+  thumbnail_cache_map (cache);
+
+  return cache;
+}
+
+void
+thumbnail_cache_free (ThumbnailCache *cache)
+{
+  g_return_if_fail (cache);
+
+  g_hash_table_destroy (cache->entries);
+  thumbnail_cache_unmap (cache);
+  g_free (cache->filepath);
+  g_free (cache);
+}
+
+gchar*
+thumbnail_cache_get_default_filepath (void)
+{
+  gchar *directory = g_build_filename (g_get_user_cache_dir (), "clutter-tutorial", NULL);
+  g_mkdir_with_parents (directory, 0700);
+
+  gchar *result = g_build_filename (directory, "full_example-thumbnails.cache", NULL);
+  g_free (directory);
+
+  return result;
+}
+
+const guchar*
+thumbnail_cache_lookup (ThumbnailCache *cache, const gchar *filepath, gint height,
+  gint *width, gint *rowstride)
+{
+  g_return_val_if_fail (cache, NULL);
+  g_return_val_if_fail (filepath, NULL);
+
+  /* We only need to stat() the file if we have a thumbnail for it: */
+  gchar *key = make_key (filepath, height);
+  const gboolean found = g_hash_table_lookup (cache->entries, key) != NULL;
+  g_free (key);
+
+  guint64 file_size = 0;
+  gint64 file_mtime = 0;
+  if (!found || !get_file_stat (filepath, &file_size, &file_mtime))
+    return NULL;
+
+  return thumbnail_cache_lookup_stat (cache, filepath, file_size, file_mtime,
+    height, width, rowstride);
+}
+
+const guchar*
+thumbnail_cache_lookup_stat (ThumbnailCache *cache, const gchar *filepath,
+  guint64 file_size, gint64 file_mtime, gint height, gint *width, gint *rowstride)
+{
+  g_return_val_if_fail (cache, NULL);
+  g_return_val_if_fail (filepath, NULL);
+
+  gchar *key = make_key (filepath, height);
+  ThumbnailCacheEntry *entry = (ThumbnailCacheEntry*)g_hash_table_lookup (cache->entries, key);
+  g_free (key);
+
+  /* Ignore the thumbnail if the image has been changed since: */
+  if (!entry || file_size != entry->file_size || file_mtime != entry->file_mtime)
+    return NULL;
+
+  entry->used = TRUE;
+
+  if (width)
+    *width = entry->width;
+  if (rowstride)
+    *rowstride = entry->rowstride;
+
+  if (entry->pixbuf)
+    return gdk_pixbuf_get_pixels (entry->pixbuf);
+  else
+    return entry->mapped_pixels;
+}
+
+void
+thumbnail_cache_add (ThumbnailCache *cache, const gchar *filepath, gint height,
+  GdkPixbuf *thumbnail)
+{
+  g_return_if_fail (cache);
+  g_return_if_fail (filepath);
+  g_return_if_fail (thumbnail);
+  g_return_if_fail (gdk_pixbuf_get_has_alpha (thumbnail));
+  g_return_if_fail (gdk_pixbuf_get_height (thumbnail) == height);
+
+  ThumbnailCacheEntry *entry = g_slice_new0 (ThumbnailCacheEntry);
+  if (!get_file_stat (filepath, &entry->file_size, &entry->file_mtime))
+  {
+    g_slice_free (ThumbnailCacheEntry, entry);
+    return;
+  }
+
+  entry->width = gdk_pixbuf_get_width (thumbnail);
+  entry->height = height;
+  entry->rowstride = gdk_pixbuf_get_rowstride (thumbnail);
+  entry->pixbuf = g_object_ref (thumbnail);
+  entry->used = TRUE;
+
+  g_hash_table_replace (cache->entries, make_key (filepath, height), entry);
+  cache->dirty = TRUE;
+}
+
+gboolean
+thumbnail_cache_is_dirty (ThumbnailCache *cache)
+{
+  g_return_val_if_fail (cache, FALSE);
+
+  return cache->dirty;
+}
+
+static const guchar*
+thumbnail_cache_entry_get_pixels (const ThumbnailCacheEntry *entry)
+{
+  return entry->pixbuf ? gdk_pixbuf_get_pixels (entry->pixbuf) : entry->mapped_pixels;
+}
+
+static gsize
+align_up (gsize offset)
+{
+  return (offset + PIXELS_ALIGNMENT - 1) / PIXELS_ALIGNMENT * PIXELS_ALIGNMENT;
+}
+
+static gboolean
+write_padding (FILE *file, gsize count)
+{
+  static const gchar zeros[PIXELS_ALIGNMENT] = { 0 };
+  return fwrite (zeros, 1, count, file) == count;
+}
+
+gboolean
+thumbnail_cache_save (ThumbnailCache *cache, GError **error)
+{
+  g_return_val_if_fail (cache, FALSE);
+
+  /* Decide where everything goes before writing anything: */
+  GPtrArray *keys = g_ptr_array_new ();
+  GPtrArray *entries = g_ptr_array_new ();
+
+  GHashTableIter iter;
+  gpointer key = NULL;
+  gpointer value = NULL;
+  g_hash_table_iter_init (&iter, cache->entries);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+  {
+    ThumbnailCacheEntry *entry = (ThumbnailCacheEntry*)value;
+    if (!entry->used)
+      continue;
+
+    g_ptr_array_add (keys, key);
+    g_ptr_array_add (entries, entry);
+  }
+
+  const guint n_records = entries->len;
+  ThumbnailCacheRecord *records = g_new0 (ThumbnailCacheRecord, n_records);
+
+  gsize offset = sizeof (ThumbnailCacheHeader) + n_records * sizeof (ThumbnailCacheRecord);
+  guint i = 0;
+  for (i = 0; i < n_records; ++i)
+  {
+    /* Skip the "<height>:" prefix of the key to get the path: */
+    const gchar *path = strchr ((const gchar*)g_ptr_array_index (keys, i), ':') + 1;
+    records[i].path_offset = offset;
+    offset += strlen (path) + 1;
+  }
+
+  for (i = 0; i < n_records; ++i)
+  {
+    const ThumbnailCacheEntry *entry = (const ThumbnailCacheEntry*)g_ptr_array_index (entries, i);
+    ThumbnailCacheRecord *record = &records[i];
+
+    offset = align_up (offset);
+    record->file_size = entry->file_size;
+    record->file_mtime = entry->file_mtime;
+    record->width = entry->width;
+    record->height = entry->height;
+    record->rowstride = entry->width * 4;
+    record->pixels_offset = offset;
+    offset += (gsize)record->rowstride * record->height;
+  }
+
+  ThumbnailCacheHeader header;
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, CACHE_MAGIC, sizeof (header.magic));
+  header.version = CACHE_VERSION;
+  header.n_records = n_records;
+  header.file_length = offset;
+
+  /* Write to a temporary file and then rename it, so that a crash cannot
+   * leave a broken cache behind, and so that our current mapping stays valid
+   * until we are finished with it:
+   */
+  gchar *temp_filepath = g_strconcat (cache->filepath, ".tmp", NULL);
+  gboolean ok = FALSE;
+  FILE *file = g_fopen (temp_filepath, "wb");
+  if (file)
+  {
+    ok = fwrite (&header, sizeof (header), 1, file) == 1;
+    if (ok && n_records)
+      ok = fwrite (records, sizeof (ThumbnailCacheRecord), n_records, file) == n_records;
+
+    gsize written = sizeof (ThumbnailCacheHeader) + n_records * sizeof (ThumbnailCacheRecord);
+    for (i = 0; ok && i < n_records; ++i)
+    {
+      const gchar *path = strchr ((const gchar*)g_ptr_array_index (keys, i), ':') + 1;
+      const gsize size = strlen (path) + 1;
+      ok = fwrite (path, 1, size, file) == size;
+      written += size;
+    }
+
+    for (i = 0; ok && i < n_records; ++i)
+    {
+      const ThumbnailCacheEntry *entry = (const ThumbnailCacheEntry*)g_ptr_array_index (entries, i);
+      const ThumbnailCacheRecord *record = &records[i];
+
+      ok = write_padding (file, record->pixels_offset - written);
+      written = record->pixels_offset;
+
+      const guchar *pixels = thumbnail_cache_entry_get_pixels (entry);
+      gint row = 0;
+      for (row = 0; ok && row < entry->height; ++row)
+      {
+        ok = fwrite (pixels + row * entry->rowstride, 1, record->rowstride, file) == record->rowstride;
+        written += record->rowstride;
+      }
+    }
+
+    if (fclose (file) != 0)
+      ok = FALSE;
+  }
+
+  if (ok)
+    ok = g_rename (temp_filepath, cache->filepath) == 0;
+
+  if (!ok)
+  {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+      "Could not write the thumbnail cache %s", cache->filepath);
+    g_unlink (temp_filepath);
+  }
+
+  g_free (temp_filepath);
+  g_free (records);
+  g_ptr_array_free (keys, TRUE);
+  g_ptr_array_free (entries, TRUE);
+
+  if (!ok)
+    return FALSE;
+
+  /* Use the new file instead of the thumbnails in memory.
+   * Everything in it was used, so keep it for the next save too:
+   */
+  g_hash_table_remove_all (cache->entries);
+  thumbnail_cache_unmap (cache);
+  thumbnail_cache_map (cache);
+  cache->dirty = FALSE;
+
+  g_hash_table_iter_init (&iter, cache->entries);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    ((ThumbnailCacheEntry*)value)->used = TRUE;
+
+  return TRUE;
+}
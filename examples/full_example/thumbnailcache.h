@@ -0,0 +1,84 @@
+/* Copyright 2007 Openismus GmbH
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef __EXAMPLE_THUMBNAIL_CACHE_H__
+#define __EXAMPLE_THUMBNAIL_CACHE_H__
+
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+/* A file of pre-scaled, premultiplied RGBA thumbnails, keyed by the image's path,
+ * its file size and modification time, and the thumbnail height.
+ * The file is memory-mapped, so cached thumbnails can be uploaded
+ * straight from the mapping, without decoding anything.
+ */
+typedef struct _ThumbnailCache ThumbnailCache;
+
+/* Maps the cache file, if it exists and is valid. Otherwise the cache
+ * starts empty, and the file is created by thumbnail_cache_save().
+ */
+ThumbnailCache *thumbnail_cache_new (const gchar *cache_filepath);
+void            thumbnail_cache_free (ThumbnailCache *cache);
+
+/* Get the cache file in the user's cache directory, creating the
+ * directory if necessary. Free the result with g_free().
+ */
+gchar          *thumbnail_cache_get_default_filepath (void);
+
+/* Returns the premultiplied RGBA pixels of the thumbnail for this file, or NULL if there is
+ * no thumbnail of this height or if the file has changed since it was cached.
+ * The pixels belong to the cache and are valid until the next
+ * thumbnail_cache_save() or thumbnail_cache_free().
+ */
+const guchar   *thumbnail_cache_lookup (ThumbnailCache *cache,
+                                        const gchar    *filepath,
+                                        gint            height,
+                                        gint           *width,
+                                        gint           *rowstride);
+
+/* Like thumbnail_cache_lookup(), but with the file's size and modification
+ * time, as st_size and st_mtime, if the caller already has them.
+ */
+const guchar   *thumbnail_cache_lookup_stat (ThumbnailCache *cache,
+                                             const gchar    *filepath,
+                                             guint64         file_size,
+                                             gint64          file_mtime,
+                                             gint            height,
+                                             gint           *width,
+                                             gint           *rowstride);
+
+/* Remember a thumbnail so that it will be written by the next
+ * thumbnail_cache_save(). The thumbnail must be premultiplied RGBA and of this height.
+ */
+void            thumbnail_cache_add (ThumbnailCache *cache,
+                                     const gchar    *filepath,
+                                     gint            height,
+                                     GdkPixbuf      *thumbnail);
+
+/* Returns TRUE if thumbnails have been added since the file was last saved. */
+gboolean        thumbnail_cache_is_dirty (ThumbnailCache *cache);
+
+/* Write all thumbnails that have been looked up or added to the cache file,
+ * then map the new file. Thumbnails that were not used are dropped,
+ * so the file does not grow forever as images are deleted.
+ */
+gboolean        thumbnail_cache_save (ThumbnailCache *cache, GError **error);
+
+G_END_DECLS
+
+#endif /* __EXAMPLE_THUMBNAIL_CACHE_H__ */